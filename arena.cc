@@ -0,0 +1,112 @@
+// arena.cc - Bump allocator for short-lived data in plain C.
+// See arena.h for documentation regarding the use of these functions.
+
+#include <stdlib.h>
+#include <string.h>
+#include "arena.h"
+
+// Size of an ordinary block. Requests larger than this get a block of their own.
+#define ARENA_BLOCKSIZE 8192
+
+// Alignment of arena_alloc() results.
+#define ARENA_ALIGN (2 * sizeof(void *))
+
+struct arena_block {
+    arena_block *next;   // the previously allocated block
+    size_t size;         // usable bytes following this header
+};
+
+void arena_init(arena *a)
+{
+    a->blocks = NULL;
+    a->ptr = a->end = a->last = NULL;
+}
+
+// Start a new block with room for at least n bytes.
+static void arena_newblock(arena *a, size_t n)
+{
+    size_t size = (n > ARENA_BLOCKSIZE) ? n : ARENA_BLOCKSIZE;
+    arena_block *b = (arena_block *)malloc(sizeof(arena_block) + ARENA_ALIGN + size);
+    b->next = a->blocks;
+    b->size = size;
+    a->blocks = b;
+    a->ptr = (char *)(b + 1);
+    a->end = a->ptr + ARENA_ALIGN + size;
+    a->last = NULL;
+}
+
+// Allocate n bytes aligned to align, which must be a power of two.
+static void *arena_alloc_aligned(arena *a, size_t n, size_t align)
+{
+    char *p = (char *)(((size_t)a->ptr + align - 1) & ~(align - 1));
+    if (a->ptr == NULL || p + n > a->end) {
+        arena_newblock(a, n);
+        p = (char *)(((size_t)a->ptr + align - 1) & ~(align - 1));
+    }
+    a->ptr = p + n;
+    a->last = p;
+    return p;
+}
+
+void *arena_alloc(arena *a, size_t n)
+{
+    return arena_alloc_aligned(a, n, ARENA_ALIGN);
+}
+
+void *arena_grow(arena *a, void *p, size_t oldsize, size_t newsize)
+{
+    if (p != NULL && p == a->last && (char *)p + newsize <= a->end) {
+        a->ptr = (char *)p + newsize;
+        return p;
+    }
+    void *q = arena_alloc(a, newsize);
+    if (p != NULL)
+        memcpy(q, p, (oldsize < newsize) ? oldsize : newsize);
+    return q;
+}
+
+char *arena_strndup(arena *a, const char *s, size_t n)
+{
+    size_t len = strnlen(s, n);
+    char *t = (char *)arena_alloc_aligned(a, len + 1, 1);
+    memcpy(t, s, len);
+    t[len] = '\0';
+    return t;
+}
+
+char *arena_strdup(arena *a, const char *s)
+{
+    size_t len = strlen(s);
+    char *t = (char *)arena_alloc_aligned(a, len + 1, 1);
+    memcpy(t, s, len + 1);
+    return t;
+}
+
+void arena_reset(arena *a)
+{
+    if (a->blocks == NULL)
+        return;
+    // Keep the oldest block, which is always an ordinary-sized one unless the
+    // very first request was oversized.
+    arena_block *b = a->blocks;
+    while (b->next != NULL) {
+        arena_block *next = b->next;
+        free(b);
+        b = next;
+    }
+    a->blocks = b;
+    a->ptr = (char *)(b + 1);
+    a->end = a->ptr + ARENA_ALIGN + b->size;
+    a->last = NULL;
+}
+
+void arena_destroy(arena *a)
+{
+    arena_block *b = a->blocks;
+    while (b != NULL) {
+        arena_block *next = b->next;
+        free(b);
+        b = next;
+    }
+    arena_init(a);
+}
@@ -0,0 +1,57 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+
+// arena.h - Bump allocator for short-lived data in plain C.
+//
+// An arena hands out memory from large blocks by simply advancing a pointer.
+// Individual allocations are never freed. Instead, everything allocated from
+// an arena is released at once by arena_reset() (which keeps one block around
+// for reuse) or arena_destroy(). This suits data that all dies together, like
+// the tokens, argv arrays and syntax tree built for one line of input:
+//   arena a;
+//   arena_init(&a);
+//   while (...) {
+//     char *s = arena_strdup(&a, "Hello");
+//     ...
+//     arena_reset(&a); // s and everything else is gone now
+//   }
+//   arena_destroy(&a);
+
+struct arena_block;
+
+// Arena state
+struct arena {
+    arena_block *blocks; // all blocks, most recently allocated first
+    char *ptr;           // next free byte in the current block
+    char *end;           // one past the last byte of the current block
+    char *last;          // start of the most recent allocation, for arena_grow()
+};
+
+// Initialize an empty arena. No memory is allocated until it is first used.
+void arena_init(arena *a);
+
+// Allocate n bytes, suitably aligned for any pointer or integer type. The
+// memory is not initialized. This never returns NULL.
+void *arena_alloc(arena *a, size_t n);
+
+// Resize an allocation from oldsize to newsize bytes and return the (possibly
+// moved) memory. If p was the most recent allocation and there is room, it is
+// extended in place; otherwise a new region is allocated and the old contents
+// copied into it. p may be NULL, in which case this is just arena_alloc().
+void *arena_grow(arena *a, void *p, size_t oldsize, size_t newsize);
+
+// Make a copy of a string, or of its first n characters, inside the arena. The
+// copy is always null terminated.
+char *arena_strdup(arena *a, const char *s);
+char *arena_strndup(arena *a, const char *s, size_t n);
+
+// Release everything allocated from the arena. One block is kept so that the
+// next round of allocations doesn't have to go back to malloc().
+void arena_reset(arena *a);
+
+// Release everything allocated from the arena, including all of its blocks.
+void arena_destroy(arena *a);
+
+#endif // ARENA_H
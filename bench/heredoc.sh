@@ -0,0 +1,44 @@
+#!/bin/sh
+# heredoc.sh - time feeding large here-documents to a command, in msh
+# and in dash, for bodies of a few sizes. Each script is just
+#   wc -c <<EOF
+#   ... SIZE megabytes of 64 byte lines ...
+#   EOF
+# so the time is reading the script, collecting the body and getting
+# it to wc. msh hands big bodies over in a memfd; dash writes them
+# into a pipe from a forked child.
+#
+# usage: bench/heredoc.sh [path/to/msh] [sizes in MB...]
+
+MSH=${1:-./msh}
+[ $# -gt 0 ] && shift
+SIZES=${*:-1 8 32}
+DASH=$(command -v dash)
+DIR=/tmp/msh-heredoc
+
+mkdir -p "$DIR"
+
+# run "$@" and print its wall time in milliseconds
+timed() {
+    start=$(date +%s%N)
+    "$@" > /dev/null
+    end=$(date +%s%N)
+    echo $(( (end - start) / 1000000 ))
+}
+
+printf '%-12s %10s %10s\n' "body" "msh ms" "dash ms"
+for mb in $SIZES; do
+    script="$DIR/body$mb.sh"
+    if [ ! -f "$script" ]; then
+        {
+            echo 'wc -c <<EOF'
+            yes 'the quick brown fox jumps over the lazy dog, again and again...' |
+                head -n $((mb * 1024 * 1024 / 64))
+            echo 'EOF'
+        } > "$script"
+    fi
+    m=$(timed "$MSH" "$script")
+    d=-
+    [ -n "$DASH" ] && d=$(timed "$DASH" "$script")
+    printf '%-12s %10s %10s\n' "${mb} MB" "$m" "$d"
+done
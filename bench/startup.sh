@@ -0,0 +1,37 @@
+#!/bin/sh
+# startup.sh - compare how long msh and dash take to start, run one
+# command and exit, the way a build system or script calls /bin/sh.
+#
+# usage: bench/startup.sh [path/to/msh] [iterations]
+#
+# Most of msh's startup cost is the dynamic loader relocating
+# libstdc++; linking it statically brings msh level with dash:
+#   g++ -O2 -static-libstdc++ -static-libgcc -o msh *.cc
+
+MSH=${1:-./msh}
+N=${2:-1000}
+DASH=$(command -v dash)
+
+if [ -z "$DASH" ]; then
+    echo "dash is not installed" >&2
+    exit 1
+fi
+
+# run "$@" N times and print the average wall time in microseconds
+bench() {
+    start=$(date +%s%N)
+    i=0
+    while [ $i -lt $N ]; do
+        "$@" > /dev/null
+        i=$((i + 1))
+    done
+    end=$(date +%s%N)
+    echo $(( (end - start) / N / 1000 ))
+}
+
+printf '%-28s %8s\n' "" "us/run"
+printf '%-28s %8s\n' "/bin/true alone" "$(bench /bin/true)"
+printf '%-28s %8s\n' "dash -c :" "$(bench "$DASH" -c :)"
+printf '%-28s %8s\n' "msh -c quit" "$(bench "$MSH" -c quit)"
+printf '%-28s %8s\n' "dash -c /bin/true" "$(bench "$DASH" -c /bin/true)"
+printf '%-28s %8s\n' "msh -c /bin/true" "$(bench "$MSH" -c /bin/true)"
@@ -0,0 +1,44 @@
+#!/bin/sh
+# walk.sh - time msh's threaded find builtin on a directory tree at
+# 1, 2, 4, ... threads (up to the number of cores), next to GNU find,
+# which walks the tree on one thread with readdir.
+#
+# usage: bench/walk.sh [path/to/msh] [tree]
+#
+# Without a tree, one with 30*30 directories of 200 files each is made
+# under /tmp. Every run reads the tree from the page cache; as root,
+# set DROP=1 to drop the caches before each run and time the disk.
+
+MSH=${1:-./msh}
+TREE=$2
+CORES=$(nproc)
+
+if [ -z "$TREE" ]; then
+    TREE=/tmp/msh-walk-tree
+    if [ ! -d "$TREE" ]; then
+        echo "making $TREE ..."
+        for a in $(seq 0 29); do
+            for b in $(seq 0 29); do
+                mkdir -p "$TREE/d$a/e$b"
+                (cd "$TREE/d$a/e$b" && seq -f 'f%g' 0 199 | xargs touch)
+            done
+        done
+    fi
+fi
+
+# run "$@" and print its wall time in milliseconds
+timed() {
+    [ -n "$DROP" ] && sync && echo 3 > /proc/sys/vm/drop_caches
+    start=$(date +%s%N)
+    "$@" > /dev/null
+    end=$(date +%s%N)
+    echo $(( (end - start) / 1000000 ))
+}
+
+printf '%-30s %8s\n' "" "ms"
+printf '%-30s %8s\n' "find (readdir, 1 thread)" "$(timed find "$TREE")"
+t=1
+while [ $t -le "$CORES" ]; do
+    printf '%-30s %8s\n' "msh find -threads $t" "$(timed "$MSH" -c "find $TREE -threads $t")"
+    t=$((t * 2))
+done
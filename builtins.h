@@ -0,0 +1,102 @@
+/*************************************************************
+ * builtins.h
+ * Purpose: the builtin command registry - a list of names
+ * and handlers, turned at compile time into a perfect hash
+ * table so finding a builtin costs one hash and one string
+ * compare however many there are
+ * note: to add a builtin, write its handler and add it to
+ * the builtins list in msh.cc; the table is rebuilt by the
+ * compiler, which refuses to build if it can't be made
+ * collision free
+*************************************************************/
+
+#ifndef BUILTINS_H
+#define BUILTINS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+struct pipeline;
+
+// A builtin gets the words of its command and the pipeline it is in.
+// It returns its exit status, or NOT_BUILTIN to have the command run
+// as a program after all (e.g. options only the real program knows).
+typedef int (*builtinFn)(char **args, pipeline *p);
+
+#define NOT_BUILTIN -1
+
+struct builtin {
+   const char *name;
+   builtinFn run;
+};
+
+#define BUILTIN_SLOTS 128 //power of two, at least twice the builtins
+
+// The hash table over a list of builtins: slot[h] is the index of the
+// builtin whose name hashes to h with this seed, or -1.
+struct builtinTable {
+   uint32_t seed;
+   signed char slot[BUILTIN_SLOTS];
+};
+
+/************************************
+ * uint32_t builtinHash(const char *, uint32_t seed)
+ * post: FNV-1a hash of the string,
+ * started from seed
+ ***********************************/
+constexpr uint32_t builtinHash(const char *s, uint32_t seed) {
+   uint32_t h = 2166136261u ^ seed;
+   for (; *s != '\0'; s++) {
+      h = (h ^ (unsigned char)*s) * 16777619u;
+   }
+   return h;
+}
+
+/************************************
+ * builtinTable makeBuiltinTable(list)
+ * pre: the names in list are unique
+ * post: a table in which every name
+ * has its own slot, using the first
+ * seed that makes that so
+ ***********************************/
+template <size_t N>
+constexpr builtinTable makeBuiltinTable(const builtin (&list)[N]) {
+   static_assert(N * 2 <= BUILTIN_SLOTS, "too many builtins for BUILTIN_SLOTS");
+   builtinTable t{};
+   for (uint32_t seed = 0; ; seed++) {
+      t.seed = seed;
+      for (int i = 0; i < BUILTIN_SLOTS; i++) {
+	 t.slot[i] = -1;
+      }
+      bool perfect = true;
+      for (size_t i = 0; i < N && perfect; i++) {
+	 uint32_t h = builtinHash(list[i].name, seed) & (BUILTIN_SLOTS - 1);
+	 if (t.slot[h] >= 0) {
+	    perfect = false;
+	 }
+	 t.slot[h] = i;
+      }
+      if (perfect) {
+	 return t;
+      }
+   }
+}
+
+/************************************
+ * const builtin *findBuiltin(table, list, name)
+ * pre: table was made from list
+ * post: the builtin called name, or
+ * NULL if there is none
+ ***********************************/
+template <size_t N>
+inline const builtin *findBuiltin(const builtinTable &table, const builtin (&list)[N],
+				  const char *name) {
+   int i = table.slot[builtinHash(name, table.seed) & (BUILTIN_SLOTS - 1)];
+   if (i >= 0 && strcmp(list[i].name, name) == 0) {
+      return &list[i];
+   }
+   return NULL;
+}
+
+#endif // BUILTINS_H
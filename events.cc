@@ -0,0 +1,264 @@
+/*************************************************************
+ * events.cc
+ * Purpose: the event loop msh waits in, see events.h
+ * note: SIGCHLD and SIGINT are blocked for the whole life of
+ * the shell and only ever arrive through the signalfd, so a
+ * signal can't slip in between checking for work and going
+ * to sleep in epoll_wait
+*************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <signal.h>
+#include <stdint.h>
+#include <math.h>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include <sys/timerfd.h>
+#include <set>
+#include "events.h"
+#include "jobs.h"
+#include "output.h"
+
+using namespace std;
+
+#define MAX_EVENTS 32
+
+static int epfd = -1;
+static int sigfd = -1;
+static bool interactive = false;
+static bool interrupted = false;
+static set<int> timers;      //timerfds we own
+static set<int> fired;       //timerfds that have expired
+static set<int> armed;       //descriptors registered by waitReadable()
+static set<int> ready;       //descriptors reported readable
+
+/************************************
+ * void initEvents(bool)
+ * pre: called at startup, and again
+ * in a forked child shell; terminal
+ * is true for an interactive shell
+ * post: the epoll set exists and
+ * SIGCHLD and SIGINT are delivered
+ * through its signalfd
+ ***********************************/
+void initEvents(bool terminal) {
+   //a child shell must not touch the epoll set it shares with
+   //its parent, so it drops it and starts a new one
+   if (epfd >= 0) {
+      close(epfd);
+      close(sigfd);
+      armed.clear();
+      ready.clear();
+   }
+   interactive = terminal;
+   interrupted = false;
+   sigset_t mask;
+   sigemptyset(&mask);
+   sigaddset(&mask, SIGCHLD);
+   sigaddset(&mask, SIGINT);
+   sigprocmask(SIG_BLOCK, &mask, NULL);
+
+   epfd = epoll_create1(EPOLL_CLOEXEC);
+   sigfd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+   struct epoll_event ev;
+   memset(&ev, 0, sizeof(ev));
+   ev.events = EPOLLIN;
+   ev.data.fd = sigfd;
+   epoll_ctl(epfd, EPOLL_CTL_ADD, sigfd, &ev);
+}
+
+/************************************
+ * void drainSignals()
+ * post: every pending signal has been
+ * read from the signalfd and handled
+ ***********************************/
+static void drainSignals() {
+   struct signalfd_siginfo info[16];
+   bool child = false;
+   while (true) {
+      int n = read(sigfd, info, sizeof(info));
+      if (n <= 0) {
+	 break;
+      }
+      for (int i = 0; i < n / (int)sizeof(info[0]); i++) {
+	 if (info[i].ssi_signo == SIGCHLD) {
+	    child = true;
+	 } else if (info[i].ssi_signo == SIGINT) {
+	    interrupted = true;
+	 }
+      }
+   }
+   if (child) {
+      //one reap collects every child that changed, however
+      //many SIGCHLDs were merged into this wakeup
+      reapJobs();
+   }
+   if (interrupted && !interactive) {
+      //a script or -c command stops at ^C, like other shells
+      exit(130);
+   }
+}
+
+/************************************
+ * bool runEvents()
+ * post: sleeps until at least one event
+ * arrives and handles everything that
+ * is ready; returns false if SIGINT
+ * has arrived and not yet been taken
+ ***********************************/
+bool runEvents() {
+   //nothing printed may sit in the buffer while we sleep
+   flushOutput();
+   struct epoll_event events[MAX_EVENTS];
+   int n = epoll_wait(epfd, events, MAX_EVENTS, -1);
+   bool timerDone = false;
+   for (int i = 0; i < n; i++) {
+      int fd = events[i].data.fd;
+      if (fd == sigfd) {
+	 drainSignals();
+      } else if (timers.count(fd)) {
+	 uint64_t expirations;
+	 if (read(fd, &expirations, sizeof(expirations)) > 0) {
+	    fired.insert(fd);
+	    timerDone = true;
+	 }
+      } else {
+	 ready.insert(fd);
+      }
+   }
+   if (timerDone) {
+      reapJobs();
+   }
+   return !interrupted;
+}
+
+/************************************
+ * int waitReadable(int fd)
+ * post: runs the loop until fd has
+ * input (returns 1), SIGINT arrives
+ * (returns 0), or fd turns out not to
+ * be pollable, like a regular file
+ * (returns -1)
+ ***********************************/
+int waitReadable(int fd) {
+   //one-shot registration, so that input nobody is waiting for
+   //can't keep waking up the loop while a command runs
+   struct epoll_event ev;
+   memset(&ev, 0, sizeof(ev));
+   ev.events = EPOLLIN | EPOLLONESHOT;
+   ev.data.fd = fd;
+   int op = armed.count(fd) ? EPOLL_CTL_MOD : EPOLL_CTL_ADD;
+   if (epoll_ctl(epfd, op, fd, &ev) < 0) {
+      if (errno == EPERM) {
+	 return -1;
+      }
+      if (errno == EEXIST || errno == ENOENT) {
+	 //fd was closed and reused behind our back, start over
+	 epoll_ctl(epfd, EPOLL_CTL_DEL, fd, NULL);
+	 if (epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+	    return -1;
+	 }
+      } else {
+	 return -1;
+      }
+   }
+   armed.insert(fd);
+   ready.erase(fd);
+
+   while (!ready.count(fd)) {
+      if (!runEvents()) {
+	 return 0;
+      }
+   }
+   ready.erase(fd);
+   return 1;
+}
+
+/************************************
+ * int addTimer(double seconds)
+ * post: a timer that fires once after
+ * the given time is added to the loop
+ * and its descriptor returned, or -1
+ ***********************************/
+int addTimer(double seconds) {
+   int fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+   if (fd < 0) {
+      return -1;
+   }
+   struct itimerspec spec;
+   memset(&spec, 0, sizeof(spec));
+   if (seconds > 0) {
+      spec.it_value.tv_sec = (time_t)seconds;
+      spec.it_value.tv_nsec = (long)((seconds - floor(seconds)) * 1e9);
+   }
+   if (spec.it_value.tv_sec == 0 && spec.it_value.tv_nsec == 0) {
+      //a zero it_value would disarm the timer instead
+      spec.it_value.tv_nsec = 1;
+   }
+   timerfd_settime(fd, 0, &spec, NULL);
+
+   struct epoll_event ev;
+   memset(&ev, 0, sizeof(ev));
+   ev.events = EPOLLIN;
+   ev.data.fd = fd;
+   epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev);
+   timers.insert(fd);
+   return fd;
+}
+
+/************************************
+ * bool timerFired(int fd)
+ * post: true once the timer has expired
+ ***********************************/
+bool timerFired(int fd) {
+   return fired.count(fd) > 0;
+}
+
+/************************************
+ * void removeTimer(int fd)
+ * post: the timer is taken out of the
+ * loop and closed
+ ***********************************/
+void removeTimer(int fd) {
+   epoll_ctl(epfd, EPOLL_CTL_DEL, fd, NULL);
+   close(fd);
+   timers.erase(fd);
+   fired.erase(fd);
+}
+
+/************************************
+ * bool sleepFor(double seconds)
+ * post: runs the loop (so children are
+ * still reaped) until the time is up;
+ * returns false if SIGINT cut it short
+ ***********************************/
+bool sleepFor(double seconds) {
+   int fd = addTimer(seconds);
+   if (fd < 0) {
+      return false;
+   }
+   bool ok = true;
+   while (!timerFired(fd)) {
+      if (!runEvents()) {
+	 ok = false;
+	 break;
+      }
+   }
+   removeTimer(fd);
+   return ok;
+}
+
+/************************************
+ * bool takeInterrupt()
+ * post: returns true if SIGINT arrived
+ * since the last call, and forgets it
+ ***********************************/
+bool takeInterrupt() {
+   bool was = interrupted;
+   interrupted = false;
+   return was;
+}
@@ -0,0 +1,21 @@
+/*************************************************************
+ * events.h
+ * Purpose: the event loop msh waits in - one epoll set that
+ * multiplexes std in, a signalfd for SIGCHLD and SIGINT, and
+ * timerfds, so the shell can react to child exits, timers
+ * and input no matter which of them it is waiting for
+*************************************************************/
+
+#ifndef EVENTS_H
+#define EVENTS_H
+
+void initEvents(bool);
+bool runEvents();
+int waitReadable(int);
+bool sleepFor(double);
+int addTimer(double);
+bool timerFired(int);
+void removeTimer(int);
+bool takeInterrupt();
+
+#endif // EVENTS_H
@@ -0,0 +1,336 @@
+/*************************************************************
+ * history.cc
+ * Purpose: command history for msh, see history.h
+ * note: nothing is read at startup. Lines typed before the
+ * history is first looked at are only appended to the file;
+ * the file itself is mapped and indexed the first time
+ * something asks for an old entry. Entries from the file
+ * point straight into the mapping, and new ones are copied
+ * into an arena, so the history is never copied around.
+ *
+ * !prefix uses an index on the first 1 to 4 characters of
+ * every entry: latest maps each such prefix to the newest
+ * entry starting with it, and each entry links back to the
+ * next older one with the same prefix, so a lookup only
+ * visits entries that share at least those characters.
+*************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include "history.h"
+#include "arena.h"
+
+using namespace std;
+
+#define HIST_INDEX_LEN 4
+
+// One line of history; text is not null terminated.
+struct histEntry {
+   const char *text;
+   int len;
+   int prev[HIST_INDEX_LEN]; //next older entry with the same first 1..4 chars, or -1
+};
+
+static vector<histEntry> entries;
+static unordered_map<uint64_t, int> latest; //prefix key -> newest entry with it
+static arena texts;                          //text of lines added this session
+static string path;                          //history file, empty for none
+static int appendFd = -1;
+static off_t fileLimit = -1;  //file size before our first append, -1 if none yet
+static bool loaded = false;
+
+/************************************
+ * void initHistory(bool)
+ * pre: called once at startup for an
+ * interactive shell; terminal is true
+ * when std in is a terminal
+ * post: history is kept from now on,
+ * in $MSH_HISTFILE if it is set, or
+ * else in ~/.msh_history when typing
+ * at a terminal; nothing is read yet
+ ***********************************/
+void initHistory(bool terminal) {
+   arena_init(&texts);
+   const char *file = getenv("MSH_HISTFILE");
+   const char *home = getenv("HOME");
+   if (file != NULL) {
+      path = file;
+   } else if (terminal && home != NULL) {
+      path = string(home) + "/.msh_history";
+   }
+}
+
+/************************************
+ * uint64_t prefixKey(const char *, int n)
+ * pre: n is 1 to HIST_INDEX_LEN
+ * post: a key for the first n chars
+ ***********************************/
+static uint64_t prefixKey(const char *s, int n) {
+   uint64_t key = n;
+   for (int i = 0; i < n; i++) {
+      key = (key << 8) | (unsigned char)s[i];
+   }
+   return key;
+}
+
+/************************************
+ * void indexEntry(int i)
+ * post: entry i is the newest in the
+ * prefix index for its first chars
+ ***********************************/
+static void indexEntry(int i) {
+   histEntry &e = entries[i];
+   for (int n = 1; n <= HIST_INDEX_LEN; n++) {
+      e.prev[n - 1] = -1;
+      if (n > e.len) {
+	 continue;
+      }
+      uint64_t key = prefixKey(e.text, n);
+      unordered_map<uint64_t, int>::iterator it = latest.find(key);
+      if (it != latest.end()) {
+	 e.prev[n - 1] = it->second;
+	 it->second = i;
+      } else {
+	 latest[key] = i;
+      }
+   }
+}
+
+/************************************
+ * void loadHistory()
+ * post: the history file (as it was
+ * before this session added to it)
+ * is mapped, its lines come before
+ * this session's, and all of them
+ * are indexed
+ ***********************************/
+static void loadHistory() {
+   if (loaded) {
+      return;
+   }
+   loaded = true;
+   vector<histEntry> session;
+   session.swap(entries);
+
+   int fd = path.empty() ? -1 : open(path.c_str(), O_RDONLY | O_CLOEXEC);
+   struct stat st;
+   if (fd >= 0 && fstat(fd, &st) == 0) {
+      off_t size = st.st_size;
+      if (fileLimit >= 0 && fileLimit < size) {
+	 size = fileLimit;
+      }
+      void *map = (size > 0) ? mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0) : MAP_FAILED;
+      if (map != MAP_FAILED) {
+	 //the mapping stays for good, entries point into it
+	 const char *p = (const char *)map;
+	 const char *end = p + size;
+	 while (p < end) {
+	    const char *nl = (const char *)memchr(p, '\n', end - p);
+	    if (nl == NULL) {
+	       nl = end;
+	    }
+	    if (nl > p) {
+	       histEntry e;
+	       e.text = p;
+	       e.len = nl - p;
+	       entries.push_back(e);
+	    }
+	    p = nl + 1;
+	 }
+      }
+   }
+   if (fd >= 0) {
+      close(fd);
+   }
+   entries.insert(entries.end(), session.begin(), session.end());
+   latest.reserve(entries.size());
+   for (int i = 0; i < (int)entries.size(); i++) {
+      indexEntry(i);
+   }
+}
+
+/************************************
+ * void addHistory(const string &line)
+ * post: line (unless it is blank or
+ * the same as the last one) is added
+ * to the history and appended to the
+ * history file
+ ***********************************/
+void addHistory(const string &line) {
+   if (line.find_first_not_of(" \t") == string::npos) {
+      return;
+   }
+   if (!entries.empty()) {
+      histEntry &last = entries.back();
+      if (last.len == (int)line.size() && memcmp(last.text, line.data(), last.len) == 0) {
+	 return;
+      }
+   }
+   histEntry e;
+   e.text = arena_strndup(&texts, line.data(), line.size());
+   e.len = line.size();
+   entries.push_back(e);
+   if (loaded) {
+      indexEntry(entries.size() - 1);
+   }
+
+   if (path.empty()) {
+      return;
+   }
+   if (appendFd < 0) {
+      appendFd = open(path.c_str(), O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0600);
+      struct stat st;
+      if (appendFd < 0) {
+	 path.clear();
+	 return;
+      }
+      if (!loaded && fstat(appendFd, &st) == 0) {
+	 //when the file is loaded, stop where our lines begin
+	 fileLimit = st.st_size;
+      }
+   }
+   //one write per line, so lines from several shells never mix
+   struct iovec iov[2];
+   iov[0].iov_base = (void *)line.data();
+   iov[0].iov_len = line.size();
+   iov[1].iov_base = (void *)"\n";
+   iov[1].iov_len = 1;
+   writev(appendFd, iov, 2);
+}
+
+/************************************
+ * int findPrefix(const char *, int)
+ * post: the newest entry that starts
+ * with the given chars, or -1
+ ***********************************/
+static int findPrefix(const char *prefix, int plen) {
+   int n = (plen < HIST_INDEX_LEN) ? plen : HIST_INDEX_LEN;
+   unordered_map<uint64_t, int>::iterator it = latest.find(prefixKey(prefix, n));
+   int i = (it != latest.end()) ? it->second : -1;
+   while (i >= 0) {
+      histEntry &e = entries[i];
+      if (e.len >= plen && memcmp(e.text, prefix, plen) == 0) {
+	 return i;
+      }
+      i = e.prev[n - 1];
+   }
+   return -1;
+}
+
+/************************************
+ * int findText(const char *, int, int)
+ * post: the newest entry older than
+ * before that contains the text, or -1
+ ***********************************/
+static int findText(const char *text, int tlen, int before) {
+   for (int i = before - 1; i >= 0; i--) {
+      if (memmem(entries[i].text, entries[i].len, text, tlen) != NULL) {
+	 return i;
+      }
+   }
+   return -1;
+}
+
+/************************************
+ * bool expandHistory(string &line)
+ * pre: line starts with '!'
+ * post: its first word (!!, !n, !-n,
+ * !?text or !prefix) is replaced by
+ * the entry it names and true is
+ * returned, or an error is printed
+ * and false returned
+ ***********************************/
+bool expandHistory(string &line) {
+   loadHistory();
+   size_t wordEnd = line.find_first_of(" \t");
+   if (wordEnd == string::npos) {
+      wordEnd = line.size();
+   }
+   string word = line.substr(1, wordEnd - 1);
+   int total = entries.size();
+   int i = -1;
+   if (word == "!") {
+      i = total - 1;
+   } else if (!word.empty() && word[0] == '?') {
+      i = findText(word.data() + 1, word.size() - 1, total);
+   } else if (!word.empty() && word.find_first_not_of("-0123456789") == string::npos) {
+      int n = atoi(word.c_str());
+      i = (n < 0) ? total + n : n - 1;
+   } else if (!word.empty()) {
+      i = findPrefix(word.data(), word.size());
+   }
+   if (i < 0 || i >= total) {
+      printf("!%s: event not found\n", word.c_str());
+      return false;
+   }
+   line = string(entries[i].text, entries[i].len) + line.substr(wordEnd);
+   return true;
+}
+
+/************************************
+ * int historyCommand(char **args)
+ * pre: args is empty or holds how
+ * many of the newest entries to show
+ * post: the history is listed with
+ * the numbers !n takes; 1 is returned
+ * if the count isn't a number >= 0
+ ***********************************/
+int historyCommand(char **args) {
+   long n = -1;
+   if (args[0] != NULL) {
+      char *end;
+      n = strtol(args[0], &end, 10);
+      if (end == args[0] || *end != '\0' || n < 0 || args[1] != NULL) {
+	 printf("usage: history [count], where count is a number 0 or more\n");
+	 return 1;
+      }
+   }
+   loadHistory();
+   int total = entries.size();
+   int first = 0;
+   if (n >= 0 && n < total) {
+      first = total - n;
+   }
+   for (int i = first; i < total; i++) {
+      printf("%5d  %.*s\n", i + 1, entries[i].len, entries[i].text);
+   }
+   return 0;
+}
+
+/************************************
+ * int searchCommand(char **args)
+ * pre: args are words to look for
+ * post: every entry containing them
+ * (as one phrase) is listed, newest
+ * first; 1 is returned if none do
+ ***********************************/
+int searchCommand(char **args) {
+   if (args[0] == NULL) {
+      printf("search: what should I look for?\n");
+      return 1;
+   }
+   loadHistory();
+   string text = args[0];
+   for (int i = 1; args[i] != NULL; i++) {
+      text += ' ';
+      text += args[i];
+   }
+   int found = 0;
+   int i = entries.size();
+   while ((i = findText(text.data(), text.size(), i)) >= 0) {
+      printf("%5d  %.*s\n", i + 1, entries[i].len, entries[i].text);
+      found++;
+   }
+   return (found > 0) ? 0 : 1;
+}
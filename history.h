@@ -0,0 +1,20 @@
+/*************************************************************
+ * history.h
+ * Purpose: command history for msh - every line typed at
+ * the prompt is kept in memory and appended to a history
+ * file, and can be listed (history), searched (search) and
+ * run again (!!, !n, !-n, !prefix, !?text)
+*************************************************************/
+
+#ifndef HISTORY_H
+#define HISTORY_H
+
+#include <string>
+
+void initHistory(bool);
+void addHistory(const std::string &);
+bool expandHistory(std::string &);
+int historyCommand(char **);
+int searchCommand(char **);
+
+#endif // HISTORY_H
@@ -0,0 +1,544 @@
+/*************************************************************
+ * jobs.cc
+ * Purpose: job table for msh, see jobs.h
+ * note: SIGCHLD only ever arrives through the event loop's
+ * signalfd (see events.cc), which calls reapJobs(); waiting
+ * on a job means running that loop until the job is idle
+*************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include "jobs.h"
+#include "events.h"
+#include "output.h"
+
+using namespace std;
+
+static vector<job *> jobs;
+static bool interactive = false;
+static bool report = true; //tell the user as processes finish
+static pid_t shellPgid;
+
+// Signals the shell ignores while it has the terminal, and which
+// every child must get back at their default disposition. SIGINT
+// isn't one of them: the event loop takes it through its signalfd.
+static const int jobSignals[] = { SIGQUIT, SIGTSTP, SIGTTIN, SIGTTOU };
+#define NJOBSIGNALS (int)(sizeof(jobSignals) / sizeof(jobSignals[0]))
+
+/************************************
+ * void initJobs(bool, bool)
+ * pre: called once at startup; terminal
+ * is true when std in is a terminal,
+ * chatty is false to finish jobs
+ * without any messages (for scripts)
+ * post: with a terminal the shell runs
+ * in its own process group and owns
+ * the terminal
+ ***********************************/
+void initJobs(bool terminal, bool chatty) {
+   interactive = terminal;
+   report = chatty;
+   if (interactive) {
+      for (int i = 0; i < NJOBSIGNALS; i++) {
+	 signal(jobSignals[i], SIG_IGN);
+      }
+      setpgid(0, 0);
+      shellPgid = getpgrp();
+      tcsetpgrp(0, shellPgid);
+   }
+}
+
+/************************************
+ * void enterSubshell()
+ * pre: called in a forked child that
+ * keeps running msh code
+ * post: the child starts with an empty
+ * job table and no job control, and
+ * its own event loop
+ ***********************************/
+void enterSubshell() {
+   interactive = false;
+   initEvents(false);
+   while (!jobs.empty()) {
+      forgetJob(jobs.back());
+   }
+}
+
+/************************************
+ * bool jobMessages()
+ * post: true if the shell should chat
+ * about the jobs it starts
+ ***********************************/
+bool jobMessages() {
+   return report;
+}
+
+/************************************
+ * bool jobControlEnabled()
+ * post: true if jobs get their own
+ * process groups and the terminal
+ ***********************************/
+bool jobControlEnabled() {
+   return interactive;
+}
+
+/************************************
+ * void childSignalDefaults(sigset_t *)
+ * post: set holds the signals a child
+ * must reset to their default action
+ ***********************************/
+void childSignalDefaults(sigset_t *set) {
+   sigemptyset(set);
+   for (int i = 0; i < NJOBSIGNALS; i++) {
+      sigaddset(set, jobSignals[i]);
+   }
+}
+
+/************************************
+ * void resetChildSignals()
+ * pre: called in a forked child
+ * post: signal handling is back to
+ * what a new program expects
+ ***********************************/
+void resetChildSignals() {
+   for (int i = 0; i < NJOBSIGNALS; i++) {
+      signal(jobSignals[i], SIG_DFL);
+   }
+   signal(SIGCHLD, SIG_DFL);
+   sigset_t none;
+   sigemptyset(&none);
+   sigprocmask(SIG_SETMASK, &none, NULL);
+}
+
+/************************************
+ * job *newJob(string, bool)
+ * pre: text is the command line
+ * post: an empty job is added to the
+ * table and returned
+ ***********************************/
+job *newJob(string text, bool background) {
+   job *j = new job;
+   j->id = jobs.empty() ? 1 : jobs.back()->id + 1;
+   j->pgid = 0;
+   j->timer = -1;
+   j->overall = JOB_RUNNING;
+   j->text = text;
+   j->background = background;
+   jobs.push_back(j);
+   return j;
+}
+
+/************************************
+ * void addProcess(job *, pid_t)
+ * pre: pid was just started for j
+ * post: pid is recorded in j and, with
+ * job control, placed in j's group
+ ***********************************/
+void addProcess(job *j, pid_t pid) {
+   if (interactive) {
+      if (j->pgid == 0) {
+	 j->pgid = pid;
+      }
+      //the child may have already done this (or exec'd), so
+      //failures here are expected and harmless
+      setpgid(pid, j->pgid);
+   }
+   j->pids.push_back(pid);
+   j->status.push_back(0);
+   j->state.push_back(JOB_RUNNING);
+}
+
+/************************************
+ * job *newTimerJob(string, double)
+ * pre: text is the command line
+ * post: a background job with no
+ * processes is added to the table; it
+ * is done once the given time is up
+ ***********************************/
+job *newTimerJob(string text, double seconds) {
+   job *j = newJob(text, true);
+   j->timer = addTimer(seconds);
+   if (j->timer < 0) {
+      forgetJob(j);
+      return NULL;
+   }
+   return j;
+}
+
+/************************************
+ * void endTimer(job *, int status)
+ * post: j's timer is gone and j is
+ * done with the given wait status
+ ***********************************/
+static void endTimer(job *j, int status) {
+   removeTimer(j->timer);
+   j->timer = -1;
+   j->status.push_back(status);
+   j->overall = JOB_DONE;
+}
+
+/************************************
+ * void forgetJob(job *)
+ * post: j is removed from the table
+ ***********************************/
+void forgetJob(job *j) {
+   if (j->timer >= 0) {
+      removeTimer(j->timer);
+   }
+   for (int i = 0; i < (int)jobs.size(); i++) {
+      if (jobs[i] == j) {
+	 jobs.erase(jobs.begin() + i);
+	 break;
+      }
+   }
+   delete j;
+}
+
+/************************************
+ * void recordStatus(pid_t, int)
+ * post: the process and job owning pid
+ * are updated with its new status
+ ***********************************/
+static void recordStatus(pid_t pid, int status) {
+   for (int i = 0; i < (int)jobs.size(); i++) {
+      job *j = jobs[i];
+      for (int k = 0; k < (int)j->pids.size(); k++) {
+	 if (j->pids[k] != pid) {
+	    continue;
+	 }
+	 if (WIFSTOPPED(status)) {
+	    j->state[k] = JOB_STOPPED;
+	 } else if (WIFCONTINUED(status)) {
+	    j->state[k] = JOB_RUNNING;
+	 } else {
+	    j->state[k] = JOB_DONE;
+	    j->status[k] = status;
+	 }
+
+	 bool running = false, stopped = false;
+	 for (int m = 0; m < (int)j->state.size(); m++) {
+	    running = running || (j->state[m] == JOB_RUNNING);
+	    stopped = stopped || (j->state[m] == JOB_STOPPED);
+	 }
+	 j->overall = running ? JOB_RUNNING : (stopped ? JOB_STOPPED : JOB_DONE);
+	 return;
+      }
+   }
+}
+
+/************************************
+ * void reapJobs()
+ * post: every child that changed state
+ * and every timer that fired since the
+ * last call is applied to the job table
+ ***********************************/
+void reapJobs() {
+   int status;
+   pid_t pid;
+   while ((pid = waitpid(-1, &status, WNOHANG | WUNTRACED | WCONTINUED)) > 0) {
+      recordStatus(pid, status);
+   }
+   for (int i = 0; i < (int)jobs.size(); i++) {
+      if (jobs[i]->timer >= 0 && timerFired(jobs[i]->timer)) {
+	 endTimer(jobs[i], 0);
+      }
+   }
+}
+
+/************************************
+ * void waitUntilIdle(job *)
+ * post: returns once j has no running
+ * processes, running the event loop
+ * until something about j changes
+ ***********************************/
+static void waitUntilIdle(job *j) {
+   reapJobs();
+   while (j->overall == JOB_RUNNING) {
+      if (!runEvents()) {
+	 //^C reaches the shell only when the job doesn't have
+	 //the terminal, which is the case for a timer job
+	 takeInterrupt();
+	 if (j->timer >= 0) {
+	    endTimer(j, W_EXITCODE(0, SIGINT));
+	 }
+      }
+   }
+}
+
+/************************************
+ * int exitCode(int status)
+ * post: a wait status is converted to
+ * the number a shell reports for it
+ ***********************************/
+static int exitCode(int status) {
+   if (WIFEXITED(status)) {
+      return WEXITSTATUS(status);
+   } else if (WIFSIGNALED(status)) {
+      return 128 + WTERMSIG(status);
+   }
+   return 128 + WSTOPSIG(status);
+}
+
+/************************************
+ * int waitForJob(job *)
+ * pre: j's processes have all started
+ * post: j runs in the foreground until
+ * it finishes or is stopped; a finished
+ * job is reported and removed from the
+ * table, a stopped one stays there; the
+ * exit code of the last process is
+ * returned
+ ***********************************/
+int waitForJob(job *j) {
+   j->background = false;
+   if (interactive && j->pgid > 0) {
+      tcsetpgrp(0, j->pgid);
+   }
+   waitUntilIdle(j);
+   if (interactive) {
+      tcsetpgrp(0, shellPgid);
+   }
+
+   if (j->overall == JOB_STOPPED) {
+      j->background = true;
+      printf("\n[%d] Stopped\t%s\n", j->id, j->text.c_str());
+      return 128 + SIGTSTP;
+   }
+   for (int i = 0; report && i < (int)j->pids.size(); i++) {
+      printf("Process %d finished with status %d\n", j->pids[i], j->status[i]);
+   }
+   int code = j->status.empty() ? 0 : exitCode(j->status.back());
+   forgetJob(j);
+   return code;
+}
+
+/************************************
+ * void notifyJobs()
+ * pre: called just before a prompt
+ * post: background jobs that finished
+ * are reported and removed
+ ***********************************/
+void notifyJobs() {
+   reapJobs();
+   for (int i = 0; i < (int)jobs.size(); i++) {
+      job *j = jobs[i];
+      if (j->background && j->overall == JOB_DONE) {
+	 int code = j->status.empty() ? 0 : exitCode(j->status.back());
+	 if (!report) {
+	    //nothing to say
+	 } else if (code == 0) {
+	    printf("[%d] Done\t%s\n", j->id, j->text.c_str());
+	 } else {
+	    printf("[%d] Exit %d\t%s\n", j->id, code, j->text.c_str());
+	 }
+	 forgetJob(j);
+	 i--;
+      }
+   }
+}
+
+/************************************
+ * job *findJob(const char *spec)
+ * pre: spec is %n, %% or %+ (the most
+ * recent job), or a process id; NULL
+ * also means the most recent job
+ * post: the matching job is returned,
+ * or NULL after printing an error
+ ***********************************/
+static job *findJob(const char *spec) {
+   reapJobs();
+   if (spec == NULL || strcmp(spec, "%%") == 0 || strcmp(spec, "%+") == 0) {
+      if (jobs.empty()) {
+	 printf("There are no jobs\n");
+	 return NULL;
+      }
+      return jobs.back();
+   }
+   bool byId = (spec[0] == '%');
+   int n = atoi(byId ? spec + 1 : spec);
+   for (int i = 0; i < (int)jobs.size(); i++) {
+      if (byId && jobs[i]->id == n) {
+	 return jobs[i];
+      }
+      for (int k = 0; !byId && k < (int)jobs[i]->pids.size(); k++) {
+	 if (jobs[i]->pids[k] == n) {
+	    return jobs[i];
+	 }
+      }
+   }
+   printf("There is no job %s\n", spec);
+   return NULL;
+}
+
+/************************************
+ * void signalJob(job *, int)
+ * post: sig is sent to every process
+ * of j that hasn't finished; a timer
+ * job is cancelled by any signal that
+ * would end a process
+ ***********************************/
+static void signalJob(job *j, int sig) {
+   if (j->timer >= 0) {
+      if (sig != SIGCONT && sig != SIGSTOP && sig != SIGTSTP) {
+	 endTimer(j, W_EXITCODE(0, sig));
+      }
+      return;
+   }
+   if (interactive && j->pgid > 0) {
+      kill(-j->pgid, sig);
+      return;
+   }
+   for (int i = 0; i < (int)j->pids.size(); i++) {
+      if (j->state[i] != JOB_DONE) {
+	 kill(j->pids[i], sig);
+      }
+   }
+}
+
+/************************************
+ * void jobsCommand(char **args)
+ * post: every job in the table is
+ * listed with its state
+ ***********************************/
+void jobsCommand(char **) {
+   reapJobs();
+   for (int i = 0; i < (int)jobs.size(); i++) {
+      job *j = jobs[i];
+      const char *state = (j->overall == JOB_RUNNING) ? "Running" :
+	 (j->overall == JOB_STOPPED) ? "Stopped" : "Done";
+      printf("[%d]%c %-8s\t%s\n", j->id, (i == (int)jobs.size() - 1) ? '+' : ' ',
+	     state, j->text.c_str());
+   }
+}
+
+/************************************
+ * void fgCommand(char **args)
+ * post: the given (or most recent) job
+ * is continued if stopped and waited
+ * on in the foreground; its exit
+ * status is returned
+ ***********************************/
+int fgCommand(char **args) {
+   job *j = findJob(args[0]);
+   if (j == NULL) {
+      return 1;
+   }
+   printf("%s\n", j->text.c_str());
+   if (j->overall == JOB_STOPPED) {
+      flushOutput();
+      signalJob(j, SIGCONT);
+      for (int i = 0; i < (int)j->state.size(); i++) {
+	 if (j->state[i] == JOB_STOPPED) {
+	    j->state[i] = JOB_RUNNING;
+	 }
+      }
+      j->overall = JOB_RUNNING;
+   }
+   return waitForJob(j);
+}
+
+/************************************
+ * void bgCommand(char **args)
+ * post: the given (or most recent)
+ * stopped job continues in the
+ * background
+ ***********************************/
+void bgCommand(char **args) {
+   job *j = findJob(args[0]);
+   if (j == NULL) {
+      return;
+   }
+   if (j->overall != JOB_STOPPED) {
+      printf("Job %d is not stopped\n", j->id);
+      return;
+   }
+   j->background = true;
+   printf("[%d] %s &\n", j->id, j->text.c_str());
+   flushOutput();
+   signalJob(j, SIGCONT);
+}
+
+/************************************
+ * void waitCommand(char **args)
+ * post: waits until the given jobs
+ * (or every running job) have no
+ * running processes left
+ ***********************************/
+void waitCommand(char **args) {
+   if (args[0] == NULL) {
+      reapJobs();
+      for (int i = 0; i < (int)jobs.size(); i++) {
+	 waitUntilIdle(jobs[i]);
+      }
+      return;
+   }
+   for (int i = 0; args[i] != NULL; i++) {
+      job *j = findJob(args[i]);
+      if (j != NULL) {
+	 waitUntilIdle(j);
+      }
+   }
+}
+
+// Signal names understood by kill, without the SIG prefix.
+static const struct { const char *name; int sig; } signalNames[] = {
+   { "HUP", SIGHUP }, { "INT", SIGINT }, { "QUIT", SIGQUIT },
+   { "KILL", SIGKILL }, { "USR1", SIGUSR1 }, { "USR2", SIGUSR2 },
+   { "TERM", SIGTERM }, { "CONT", SIGCONT }, { "STOP", SIGSTOP },
+   { "TSTP", SIGTSTP }, { NULL, 0 }
+};
+
+/************************************
+ * void killCommand(char **args)
+ * pre: args are [-signal] followed by
+ * job specs (%n) or process ids
+ * post: the signal (TERM by default)
+ * is sent to each of them
+ ***********************************/
+void killCommand(char **args) {
+   int sig = SIGTERM;
+   int i = 0;
+   if (args[0] != NULL && args[0][0] == '-') {
+      const char *name = args[0] + 1;
+      if (strncmp(name, "SIG", 3) == 0) {
+	 name += 3;
+      }
+      sig = atoi(name);
+      for (int k = 0; sig == 0 && signalNames[k].name != NULL; k++) {
+	 if (strcmp(name, signalNames[k].name) == 0) {
+	    sig = signalNames[k].sig;
+	 }
+      }
+      if (sig <= 0) {
+	 printf("kill: unknown signal %s\n", args[0]);
+	 return;
+      }
+      i++;
+   }
+   if (args[i] == NULL) {
+      printf("kill: expected a job (%%n) or a process id\n");
+      return;
+   }
+   for (; args[i] != NULL; i++) {
+      if (args[i][0] == '%') {
+	 job *j = findJob(args[i]);
+	 if (j != NULL) {
+	    signalJob(j, sig);
+	 }
+	 continue;
+      }
+      //a pid of 0 or below would signal a whole group, msh's own included
+      char *end;
+      long pid = strtol(args[i], &end, 10);
+      if (end == args[i] || *end != '\0' || pid <= 0 || pid > INT_MAX) {
+	 printf("kill: %s: arguments must be process or job IDs\n", args[i]);
+      } else if (kill((pid_t)pid, sig) < 0) {
+	 printf("kill: could not signal %s: %s\n", args[i], strerror(errno));
+      }
+   }
+}
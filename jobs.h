@@ -0,0 +1,53 @@
+/*************************************************************
+ * jobs.h
+ * Purpose: job table for msh - every pipeline the shell
+ * starts is a job, made of one process per command. Exited
+ * children are reaped as soon as SIGCHLD arrives and their
+ * statuses are recorded here, so background jobs never
+ * linger as zombies. A job may also be a bare timer with no
+ * processes at all, which is how `sleep N &` runs.
+*************************************************************/
+
+#ifndef JOBS_H
+#define JOBS_H
+
+#include <string>
+#include <vector>
+#include <signal.h>
+#include <sys/types.h>
+
+enum jobState { JOB_RUNNING, JOB_STOPPED, JOB_DONE };
+
+struct job {
+   int id;                      //the n in %n
+   pid_t pgid;                  //process group, 0 until the first process starts
+   int timer;                   //timerfd of a timer job, -1 otherwise
+   std::vector<pid_t> pids;     //one per command, left to right
+   std::vector<int> status;     //last wait status of each process
+   std::vector<jobState> state; //state of each process
+   jobState overall;            //state of the job as a whole
+   std::string text;            //the command line, for listings
+   bool background;             //not currently waited on by the shell
+};
+
+void initJobs(bool, bool);
+void enterSubshell();
+bool jobControlEnabled();
+bool jobMessages();
+job *newJob(std::string, bool);
+job *newTimerJob(std::string, double);
+void addProcess(job *, pid_t);
+void childSignalDefaults(sigset_t *);
+void resetChildSignals();
+int waitForJob(job *);
+void reapJobs();
+void notifyJobs();
+void forgetJob(job *);
+
+void jobsCommand(char **);
+int fgCommand(char **);
+void bgCommand(char **);
+void waitCommand(char **);
+void killCommand(char **);
+
+#endif // JOBS_H
@@ -12,29 +12,198 @@
 #include <string.h>
 #include "lexer.h"
 #include "stringlist.h"
+#include "arena.h"
 
+// Character classes, looked up in lexer_class[] so that each character of a
+// word is classified with a single table access.
+enum {
+    LC_BLANK = 1,    // ends a word: space, tab, or the null terminator
+    LC_QUOTE = 2,    // starts a quoted string
+    LC_ESCAPE = 4,   // backslash
+    LC_COMMENT = 8,  // starts a comment
+};
 
-void lexer_init(lexer *x, const char *line)
+static unsigned char lexer_class[256];
+
+// Fill in lexer_class[] the first time a lexer is initialized.
+static void lexer_class_init()
+{
+    static bool ready = false;
+    if (ready)
+        return;
+    lexer_class[(unsigned char)'\0'] = LC_BLANK;
+    lexer_class[(unsigned char)' '] = LC_BLANK;
+    lexer_class[(unsigned char)'\t'] = LC_BLANK;
+    lexer_class[(unsigned char)'\''] = LC_QUOTE;
+    lexer_class[(unsigned char)'"'] = LC_QUOTE;
+    lexer_class[(unsigned char)'\\'] = LC_ESCAPE;
+    lexer_class[(unsigned char)'#'] = LC_COMMENT;
+    ready = true;
+}
+
+// One state of the specials trie. next[c] is the state reached by reading
+// character c, or 0 if no special continues that way (state 0 is the root, so
+// it can never be a target). match is the index of the special token that
+// ends at this state, or -1.
+struct lexer_trie_node {
+    short next[256];
+    short match;
+};
+
+struct lexer_specials {
+    lexer_trie_node *nodes;
+    int nnodes;
+};
+
+// Trie used when there are no specials at all, so that lexers which don't
+// need any (like split_words()) never allocate one.
+static lexer_trie_node no_specials_root = { {0}, -1 };
+static lexer_specials no_specials_trie = { &no_specials_root, 1 };
+
+lexer_specials *lexer_compile_specials(char **specials)
+{
+    if (specials == NULL || specials[0] == NULL)
+        return &no_specials_trie;
+    int total = 1;
+    for (int i = 0; specials[i] != NULL; i++)
+        total += strlen(specials[i]);
+    lexer_specials *t = (lexer_specials *)malloc(sizeof(lexer_specials));
+    t->nodes = (lexer_trie_node *)calloc(total, sizeof(lexer_trie_node));
+    t->nnodes = 1;
+    t->nodes[0].match = -1;
+    for (int i = 0; specials[i] != NULL; i++) {
+        int state = 0;
+        for (const unsigned char *c = (const unsigned char *)specials[i]; *c; c++) {
+            if (t->nodes[state].next[*c] == 0) {
+                t->nodes[t->nnodes].match = -1;
+                t->nodes[state].next[*c] = t->nnodes++;
+            }
+            state = t->nodes[state].next[*c];
+        }
+        // If the same special is listed twice, the first one wins.
+        if (state != 0 && t->nodes[state].match < 0)
+            t->nodes[state].match = i;
+    }
+    return t;
+}
+
+void lexer_free_specials(lexer_specials *t)
+{
+    if (t == NULL || t == &no_specials_trie)
+        return;
+    free(t->nodes);
+    free(t);
+}
+
+static void lexer_unescape(lexer *x, char *original);
+
+// Set up the fields shared by all the lexer_init*() functions.
+static void lexer_setup(lexer *x, char *buf, int len, arena *a, bool views)
 {
-    x->line = strdup(line);
-    x->len = strlen(line);
+    static char *no_specials[] = { NULL };
+    lexer_class_init();
+    x->line = buf;
+    x->len = len;
     x->pos = 0;
     x->errmsg = NULL;
     x->tstr = NULL;
     x->ttype = NONE;
-    x->specials = stringlist_empty();
+    x->specials = a ? no_specials : stringlist_empty();
+    x->mem = a;
+    x->compiled = NULL;
+    x->owns_compiled = false;
+    x->views = views;
+    x->spill = NULL;
+    x->tpos = x->tlen = 0;
+    x->tescaped = false;
+}
+
+void lexer_init(lexer *x, const char *line)
+{
+    lexer_setup(x, strdup(line), strlen(line), NULL, false);
+}
+
+void lexer_init_arena(lexer *x, const char *line, arena *a)
+{
+    lexer_setup(x, arena_strdup(a, line), strlen(line), a, false);
+}
+
+void lexer_init_views(lexer *x, const char *line, arena *a)
+{
+    // One buffer holds the line followed by an equally large spill area, which
+    // is all the room lexer_token() could ever need for copies.
+    int len = strlen(line);
+    size_t size = 2 * (len + 1);
+    char *buf = a ? (char *)arena_alloc(a, size) : (char *)malloc(size);
+    memcpy(buf, line, len + 1);
+    lexer_setup(x, buf, len, a, true);
+    x->spill = buf + len + 1;
+}
+
+char *lexer_token(lexer *x)
+{
+    if (!x->views || x->ttype == NONE)
+        return NULL;
+    char *start = &x->line[x->tpos];
+    int end = x->tpos + x->tlen;
+    unsigned char next = x->line[end];
+    char *str;
+    if (end == x->len || next == '\'' || next == '"' ||
+            (lexer_class[next] & (LC_BLANK | LC_COMMENT))) {
+        // The character after the token is a closing quote, whitespace or the
+        // start of a comment, none of which the lexer looks at again, so the
+        // token can be terminated and unescaped right where it is.
+        if (lexer_class[next] & LC_COMMENT)
+            x->len = end;
+        x->line[end] = '\0';
+        str = start;
+    } else {
+        // The token runs straight into a special, which must stay intact for
+        // the next call to lexer_next(), so copy the token to the spill area.
+        str = x->spill;
+        memcpy(str, start, x->tlen);
+        str[x->tlen] = '\0';
+        x->spill += x->tlen + 1;
+    }
+    if (x->tescaped) {
+        lexer_unescape(x, str);
+        x->tescaped = false;
+    }
+    // Make later calls for the same token return the same string.
+    x->tpos = str - x->line;
+    x->tlen = strlen(str);
+    return str;
 }
 
 void lexer_destroy(lexer *x)
 {
-    free(x->line);
+    if (!x->mem)
+        free(x->line);
     x->len = x->pos = 0;
     x->errmsg = NULL;
     if (x->tstr) {
-        free(x->tstr);
+        if (!x->mem)
+            free(x->tstr);
         x->tstr = NULL;
     }
     x->ttype = NONE;
+    if (!x->mem)
+        stringlist_free(&x->specials);
+    x->specials = NULL;
+    x->mem = NULL;
+    if (x->owns_compiled)
+        lexer_free_specials((lexer_specials *)x->compiled);
+    x->compiled = NULL;
+    x->owns_compiled = false;
+}
+
+// Copy the first n characters of s into a new token string.
+static char *lexer_strndup(lexer *x, const char *s, int n)
+{
+    if (x->mem)
+        return arena_strndup(x->mem, s, n);
+    else
+        return strndup(s, n);
 }
 
 // Get the character a the current position, or '\0' if at end of line.
@@ -58,10 +227,12 @@ static char *lexer_str(lexer *x)
 // Check if c is whitespace.
 static bool is_blank(char c)
 {
-    return (c == '\0' || c == ' ' || c == '\t');
+    return (lexer_class[(unsigned char)c] & LC_BLANK) != 0;
 }
 
-// Check if s begins with an escaped whitespace, comment character, or quote.
+// Check if s begins with an escaped whitespace, comment character, quote,
+// '$' or wildcard (which the parser treats as a variable or a pattern
+// otherwise).
 static bool is_escaped_whitespace(lexer *x, char *s)
 {
     if (s != NULL && s[0] == '\\') {
@@ -72,6 +243,10 @@ static bool is_escaped_whitespace(lexer *x, char *s)
             case '#':
             case '\'':
             case '"':
+            case '$':
+            case '*':
+            case '?':
+            case '[':
                 return true;
             case '\0':
                 x->errmsg = "Error parsing string: trailing backslash is not allowed.";
@@ -84,19 +259,29 @@ static bool is_escaped_whitespace(lexer *x, char *s)
     return false;
 }
 
-// Check if c is the start of a special symbol. Returns the index if matched,
-// otherwise returns -1.
-static int match_special(lexer *x, char *s)
+// Check if s begins with a special symbol. Returns the index if matched, and
+// sets *n to its length, otherwise returns -1. The specials trie is walked one
+// character at a time, remembering the last special seen, so the longest match
+// wins and the cost doesn't depend on how many specials there are.
+static int match_special(lexer *x, const char *s, int *n)
 {
     if (s == NULL)
         return -1;
-    for (int i = 0; x->specials[i] != NULL; i++) {
-        int n = strlen(x->specials[i]);
-        if (!strncmp(s, x->specials[i], n)) {
-            return i;
+    const lexer_trie_node *nodes = x->compiled->nodes;
+    int state = nodes[0].next[(unsigned char)s[0]];
+    if (state == 0)
+        return -1;
+    int found = -1;
+    for (int i = 1; state != 0; i++) {
+        if (nodes[state].match >= 0) {
+            found = nodes[state].match;
+            *n = i;
         }
+        if (s[i] == '\0')
+            break;
+        state = nodes[state].next[(unsigned char)s[i]];
     }
-    return -1;
+    return found;
 }
 
 // Overwrite a string with an un-escaped version of itself. Returns NULL on success,
@@ -147,7 +332,8 @@ static void lexer_set(lexer *x, char *str) {
     // Overwrite the string with an un-escaped version of itself.
     lexer_unescape(x, str);
     if (x->errmsg) {
-        free(str);
+        if (!x->mem)
+            free(str);
         return;
     } else {
         x->tstr = str;
@@ -155,78 +341,150 @@ static void lexer_set(lexer *x, char *str) {
     }
 }
 
+// set the current token to WORD, as a view of len characters at pos
+static void lexer_view(lexer *x, int pos, int len, bool escaped) {
+    if (x->errmsg)
+        return;
+    x->tpos = pos;
+    x->tlen = len;
+    x->tescaped = escaped;
+    x->ttype = WORD;
+}
+
+// Skip from just after an opening quote q to its matching quote, leaving the
+// position on the closing quote. Sets *escaped if any backslash was seen.
+// Returns false (with an error) if the quote is never closed.
+static bool lexer_skip_quoted(lexer *x, char q, bool *escaped)
+{
+    while (lexer_ch(x) && lexer_ch(x) != q) {
+        if (lexer_ch(x) == '\\') {
+            // If we see a backslash, skip this character...
+            *escaped = true;
+            x->pos++;
+            // ... and the next (if there is one)
+            if (lexer_ch(x))
+                x->pos++;
+        } else {
+            // If it wasn't a backslash, skip it.
+            x->pos++;
+        }
+    }
+    if (!lexer_ch(x)) {
+        x->errmsg = "Error parsing string: no matching quote.";
+        return false;
+    }
+    return true;
+}
+
+// Is s[0, n) a variable name, as in the NAME of NAME=value?
+static bool is_name(const char *s, int n)
+{
+    if (n == 0 || (s[0] >= '0' && s[0] <= '9'))
+        return false;
+    for (int i = 0; i < n; i++) {
+        char c = s[i];
+        if (!((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_' ||
+                (c >= '0' && c <= '9')))
+            return false;
+    }
+    return true;
+}
+
 // Advance to next token. 
 void lexer_next(lexer *x)
 {
     if (x->tstr) {
-        free(x->tstr);
+        if (!x->mem)
+            free(x->tstr);
         x->tstr = NULL;
     }
     x->ttype = NONE;
 
-    // Skip whitespace before the token
-    while (lexer_ch(x) && is_blank(lexer_ch(x)))
+    if (x->compiled == NULL) {
+        x->compiled = lexer_compile_specials(x->specials);
+        x->owns_compiled = true;
+    }
+
+    // Skip whitespace before the token. In view mode this includes the null
+    // characters lexer_token() leaves behind, so check the position instead
+    // of looking for the terminator.
+    while (x->pos < x->len && is_blank(lexer_ch(x)))
         x->pos++;
 
     // No characters left in line?
-    if (!lexer_ch(x))
+    if (x->pos >= x->len)
         return;
 
     // Examine the suffix starting at the current position
     char *s = lexer_str(x);
     int startpos = x->pos++;
 
-    int i;
+    int i, n;
+    int cls = lexer_class[(unsigned char)s[0]];
 
-    if (s[0] == '#') {
+    if (cls & LC_COMMENT) {
         x->pos = x->len; // skip to end
-    } else if ((i = match_special(x, s)) >= 0) {
-        int n = strlen(x->specials[i]);
+    } else if ((i = match_special(x, s, &n)) >= 0) {
         x->pos += (n-1);
-        x->tstr = strndup(s, n);
+        if (x->views) {
+            x->tpos = startpos;
+            x->tlen = n;
+        } else {
+            x->tstr = lexer_strndup(x, s, n);
+        }
         x->ttype = (TokenType)(2 + i);
-    } else if (s[0] == '\'' || s[0] == '"') {
+    } else if (cls & LC_QUOTE) {
         // This is a quoted string, so find the matching quote
-        while (lexer_ch(x) && lexer_ch(x) != s[0]) {
-            if (lexer_ch(x) == '\\') {
-                // If we see a backslash, skip this character...
-                x->pos++;
-                // ... and the next (if there is one)
-                if (lexer_ch(x))
-                    x->pos++;
-            } else {
-                // If it wasn't a backslash, skip it.
-                x->pos++;
-            }
-        }
-        if (!lexer_ch(x)) {
-            x->errmsg = "Error parsing string: no matching quote.";
+        bool escaped = false;
+        if (!lexer_skip_quoted(x, s[0], &escaped))
             return;
-        }
         // Copy the inside of the quoted string
         int endpos = x->pos;
         x->pos++;
-        char *str = strndup(s+1, endpos-startpos-1);
+        if (x->views) {
+            lexer_view(x, startpos+1, endpos-startpos-1, escaped);
+            return;
+        }
+        char *str = lexer_strndup(x, s+1, endpos-startpos-1);
         lexer_set(x, str);
     } else {
         // Unquoted word, just look for next word boundary or end of line.
-        // But also skip over escaped whitespace.
+        // But also skip over escaped whitespace. In the value of an
+        // assignment (NAME="a b") quotes are allowed, and are skipped over
+        // whole; the quotes are left in the word for the caller to remove.
+        bool escaped = false;
+        bool value = false;
         if (is_escaped_whitespace(x, s)) {
+            escaped = true;
             x->pos++;
         }
+        const short *starts = x->compiled->nodes[0].next;
         for (;;) {
-            if (is_blank(lexer_ch(x)))
+            unsigned char c = lexer_ch(x);
+            int cls = lexer_class[c];
+            if (cls & (LC_BLANK | LC_COMMENT))
                 break;
-            if (lexer_ch(x) == '#')
+            if (starts[c] && match_special(x, lexer_str(x), &n) != -1)
                 break;
-            if (match_special(x, lexer_str(x)) != -1)
-                break;
-            if (is_escaped_whitespace(x, lexer_str(x)))
+            if (c == '=' && !value)
+                value = is_name(s, x->pos - startpos);
+            if ((cls & LC_QUOTE) && value) {
                 x->pos++;
+                if (!lexer_skip_quoted(x, c, &escaped))
+                    return;
+            } else if (cls & LC_ESCAPE) {
+                escaped = true;
+                if (is_escaped_whitespace(x, lexer_str(x)))
+                    x->pos++;
+            }
             x->pos++;
         }
         int endpos = x->pos;
-        char *str = strndup(s, endpos-startpos);
+        if (x->views) {
+            lexer_view(x, startpos, endpos-startpos, escaped);
+            return;
+        }
+        char *str = lexer_strndup(x, s, endpos-startpos);
         lexer_set(x, str);
     }
 }
@@ -12,9 +12,14 @@
 // The lexer takes a string and breaks it up into tokens. Each token is a
 // a plain word, or a double-quoted or single-quoted string. Escapes
 // are handled within quoted strings, and whitespace can be escaped outside of
-// quoted strings. Anything following a '#' character is ignored.
+// quoted strings. Anything following a '#' character is ignored. A plain word
+// of the form NAME=value may have quoted strings in its value (X="a b"); they
+// stay in the word, quotes and all.
 // Special
 
+struct arena;
+struct lexer_specials;
+
 enum TokenType {
     NONE = 0,
     WORD = 1,
@@ -34,11 +39,54 @@ struct lexer {
     char *tstr;          // the current token as a string
     TokenType ttype;     // the type of the current token
     char **specials;     // NULL terminated list of special tokens (TokenType = 2+i)
+    arena *mem;          // arena holding line and tokens, or NULL if they are malloc()ed
+    const lexer_specials *compiled; // specials compiled for matching, see below
+    bool owns_compiled;  // compiled was built by lexer_next() and is freed by lexer_destroy()
+    bool views;          // view mode, see lexer_init_views()
+    int tpos;            // view mode: offset of the current token's text within line
+    int tlen;            // view mode: length of that text, not counting any quotes
+    bool tescaped;       // view mode: that text still contains backslash escapes
+    char *spill;         // view mode: next free byte after line for lexer_token() copies
 };
 
+// Special tokens are matched with a trie built from the specials list, so the
+// cost of lexing doesn't grow with the number of specials. When several
+// specials match at the same position the longest one wins (so ">>" is never
+// mistaken for ">"). By default the trie is built on the first call to
+// lexer_next() and freed by lexer_destroy(). A caller that lexes many lines with
+// the same specials can compile them once and set x->compiled after
+// lexer_init(), in which case the lexer uses that trie and never frees it.
+lexer_specials *lexer_compile_specials(char **specials);
+
+// Free a trie returned by lexer_compile_specials().
+void lexer_free_specials(lexer_specials *t);
+
 // Initialize the lexer with a new string to be lexed.
 void lexer_init(lexer *x, const char *line);
 
+// Initialize the lexer with a new string to be lexed, allocating the private
+// copy of the line and every token from arena a instead of with malloc(). Tokens
+// then remain valid after lexer_next() and lexer_destroy(), until the arena is
+// reset. In this mode specials starts out empty and is never freed by the
+// lexer, so the caller may point it at a list it owns.
+void lexer_init_arena(lexer *x, const char *line, arena *a);
+
+// Initialize the lexer in view mode. The line is copied once into a buffer
+// (allocated from arena a, or with malloc() if a is NULL) and tokens are not
+// copied at all: after lexer_next(), tstr stays NULL and the token is described
+// by (tpos, tlen, tescaped) instead, a range of x->line that still holds the
+// raw text. Call lexer_token() to turn the current token into a string.
+void lexer_init_views(lexer *x, const char *line, arena *a);
+
+// View mode only: return the current token as a null terminated, unescaped
+// string inside the lexer's buffer. Usually this is done in place, by writing
+// the terminator over the whitespace or quote that ended the token and
+// unescaping in place (which only ever shrinks the text), so no copy is made.
+// Only a token immediately followed by a special is copied, into spare room
+// at the end of the same buffer. The string lives as long as the buffer does,
+// and this must be called before the next lexer_next().
+char *lexer_token(lexer *x);
+
 // Advance to next token. 
 void lexer_next(lexer *x);
 
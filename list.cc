@@ -0,0 +1,273 @@
+/*************************************************************
+ * list.cc
+ * Purpose: the list builtin, see list.h
+ * note: directories are read with getdents64 into one large
+ * buffer, so a big directory takes a handful of system
+ * calls instead of one per entry; everything is printed
+ * through stdio, which msh keeps fully buffered (see
+ * output.h), so a listing costs a write per buffer too
+*************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+#include "list.h"
+#include "arena.h"
+
+using namespace std;
+
+#define DIRENT_BUFSIZE (256 * 1024)
+
+// One directory entry; the name lives in the listing's arena.
+struct listEntry {
+   const char *name;
+   unsigned char type; //DT_* from getdents64, may be DT_UNKNOWN
+};
+
+// Options of one list command.
+struct listOptions {
+   bool details;   //-l
+   bool recursive; //-R
+   bool sorted;    //cleared by -U
+};
+
+static char *direntBuf = NULL;
+
+/************************************
+ * bool entryBefore(listEntry, listEntry)
+ * post: true if a sorts before b
+ ***********************************/
+static bool entryBefore(const listEntry &a, const listEntry &b) {
+   return strcmp(a.name, b.name) < 0;
+}
+
+/************************************
+ * bool readEntries(int, arena *, vector<listEntry> &)
+ * pre: dirfd is open on a directory
+ * post: every entry of it is added to
+ * entries; false is returned if the
+ * directory couldn't be read
+ ***********************************/
+static bool readEntries(int dirfd, arena *a, vector<listEntry> &entries) {
+   while (true) {
+      ssize_t n = getdents64(dirfd, direntBuf, DIRENT_BUFSIZE);
+      if (n < 0) {
+	 return false;
+      }
+      if (n == 0) {
+	 return true;
+      }
+      for (ssize_t pos = 0; pos < n; ) {
+	 struct dirent64 *d = (struct dirent64 *)(direntBuf + pos);
+	 listEntry e;
+	 e.name = arena_strdup(a, d->d_name);
+	 e.type = d->d_type;
+	 entries.push_back(e);
+	 pos += d->d_reclen;
+      }
+   }
+}
+
+/************************************
+ * void modeString(mode_t, char *)
+ * pre: buf holds at least 11 chars
+ * post: buf holds mode the way ls -l
+ * shows it, like drwxr-xr-x
+ ***********************************/
+static void modeString(mode_t mode, char *buf) {
+   buf[0] = S_ISDIR(mode) ? 'd' : S_ISLNK(mode) ? 'l' : S_ISCHR(mode) ? 'c' :
+      S_ISBLK(mode) ? 'b' : S_ISFIFO(mode) ? 'p' : S_ISSOCK(mode) ? 's' : '-';
+   const char *rwx = "rwxrwxrwx";
+   for (int i = 0; i < 9; i++) {
+      buf[i + 1] = (mode & (1 << (8 - i))) ? rwx[i] : '-';
+   }
+   if (mode & S_ISUID) {
+      buf[3] = (mode & S_IXUSR) ? 's' : 'S';
+   }
+   if (mode & S_ISGID) {
+      buf[6] = (mode & S_IXGRP) ? 's' : 'S';
+   }
+   if (mode & S_ISVTX) {
+      buf[9] = (mode & S_IXOTH) ? 't' : 'T';
+   }
+   buf[10] = '\0';
+}
+
+/************************************
+ * void printDetails(int, listEntry &)
+ * pre: dirfd is the entry's directory
+ * post: a line like ls -ln prints is
+ * printed for the entry
+ ***********************************/
+static void printDetails(int dirfd, listEntry &e) {
+   struct stat st;
+   if (fstatat(dirfd, e.name, &st, AT_SYMLINK_NOFOLLOW) < 0) {
+      printf("?????????? %s (%s)\n", e.name, strerror(errno));
+      return;
+   }
+   char mode[11];
+   modeString(st.st_mode, mode);
+   char when[32];
+   struct tm tmv;
+   localtime_r(&st.st_mtime, &tmv);
+   strftime(when, sizeof(when), "%b %e %H:%M", &tmv);
+   printf("%s %3lu %5u %5u %10lld %s %s", mode,
+	  (unsigned long)st.st_nlink, st.st_uid, st.st_gid,
+	  (long long)st.st_size, when, e.name);
+   if (S_ISLNK(st.st_mode)) {
+      char target[4096];
+      ssize_t n = readlinkat(dirfd, e.name, target, sizeof(target) - 1);
+      if (n >= 0) {
+	 target[n] = '\0';
+	 printf(" -> %s", target);
+      }
+   }
+   putchar('\n');
+   if (e.type == DT_UNKNOWN) {
+      e.type = S_ISDIR(st.st_mode) ? DT_DIR : DT_REG;
+   }
+}
+
+/************************************
+ * bool isSubdirectory(int, listEntry &)
+ * post: true if the entry is a real
+ * directory (not a link to one) other
+ * than . and ..
+ ***********************************/
+static bool isSubdirectory(int dirfd, listEntry &e) {
+   if (strcmp(e.name, ".") == 0 || strcmp(e.name, "..") == 0) {
+      return false;
+   }
+   if (e.type == DT_UNKNOWN) {
+      //some filesystems don't fill in d_type
+      struct stat st;
+      if (fstatat(dirfd, e.name, &st, AT_SYMLINK_NOFOLLOW) == 0 && S_ISDIR(st.st_mode)) {
+	 e.type = DT_DIR;
+      }
+   }
+   return e.type == DT_DIR;
+}
+
+/************************************
+ * bool listDirectory(int, string, listOptions &)
+ * pre: dirfd is open on the directory
+ * named path; this takes it over and
+ * closes it
+ * post: its entries are printed, and
+ * with -R those of every directory
+ * below it; false is returned if any
+ * couldn't be read
+ ***********************************/
+static bool listDirectory(int dirfd, const string &path, listOptions &opts) {
+   arena names;
+   arena_init(&names);
+   vector<listEntry> entries;
+   bool ok = readEntries(dirfd, &names, entries);
+   if (!ok) {
+      printf("Error: Can't read directory %s: %s\n", path.c_str(), strerror(errno));
+   }
+   if (opts.sorted) {
+      sort(entries.begin(), entries.end(), entryBefore);
+   }
+
+   for (size_t i = 0; i < entries.size(); i++) {
+      if (opts.details) {
+	 printDetails(dirfd, entries[i]);
+      } else {
+	 fputs(entries[i].name, stdout);
+	 putchar('\n');
+      }
+   }
+
+   if (opts.recursive) {
+      for (size_t i = 0; i < entries.size(); i++) {
+	 if (!isSubdirectory(dirfd, entries[i])) {
+	    continue;
+	 }
+	 string sub = path + "/" + entries[i].name;
+	 printf("\n%s:\n", sub.c_str());
+	 int fd = openat(dirfd, entries[i].name,
+			 O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+	 if (fd < 0) {
+	    printf("Error: Can't open directory %s: %s\n", sub.c_str(), strerror(errno));
+	    ok = false;
+	    continue;
+	 }
+	 ok = listDirectory(fd, sub, opts) && ok;
+      }
+   }
+
+   close(dirfd);
+   arena_destroy(&names);
+   return ok;
+}
+
+/************************************
+ * int listCommand(char **args)
+ * pre: args are [-l] [-R] [-U] and
+ * one or more directory names
+ * post: each directory is listed,
+ * sorted by name unless -U is given;
+ * 1 is returned if any directory
+ * couldn't be listed, 0 otherwise
+ ***********************************/
+int listCommand(char **args) {
+   listOptions opts;
+   opts.details = false;
+   opts.recursive = false;
+   opts.sorted = true;
+   int i = 0;
+   for (; args[i] != NULL && args[i][0] == '-' && args[i][1] != '\0'; i++) {
+      for (const char *c = args[i] + 1; *c != '\0'; c++) {
+	 if (*c == 'l') {
+	    opts.details = true;
+	 } else if (*c == 'R') {
+	    opts.recursive = true;
+	 } else if (*c == 'U') {
+	    opts.sorted = false;
+	 } else {
+	    printf("list: unknown option -%c\n", *c);
+	    return 1;
+	 }
+      }
+   }
+   if (args[i] == NULL) {
+      printf("Please enter a valid directory\n");
+      return 1;
+   }
+
+   if (direntBuf == NULL) {
+      direntBuf = (char *)malloc(DIRENT_BUFSIZE);
+   }
+   int status = 0;
+   bool many = (args[i + 1] != NULL);
+   for (; args[i] != NULL; i++) {
+      int fd = open(args[i], O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+      if (fd < 0) {
+	 printf("Error: Can't open directory\n");
+	 status = 1;
+	 continue;
+      }
+      if (many || opts.recursive) {
+	 printf("%s:\n", args[i]);
+      } else {
+	 printf("The contents of the directory are: \n");
+      }
+      if (!listDirectory(fd, args[i], opts)) {
+	 status = 1;
+      }
+      if (many && args[i + 1] != NULL) {
+	 putchar('\n');
+      }
+   }
+   return status;
+}
@@ -0,0 +1,13 @@
+/*************************************************************
+ * list.h
+ * Purpose: the list builtin - prints the entries of one or
+ * more directories, optionally with details (-l), recursing
+ * into subdirectories (-R), or in directory order (-U)
+*************************************************************/
+
+#ifndef LIST_H
+#define LIST_H
+
+int listCommand(char **);
+
+#endif // LIST_H
@@ -4,8 +4,9 @@
  * Date: 2/28/16
  * Class: CSCI 346
  * Purpose: to implement a miniture version of a bash shell 
- * note: does not handle spaces within arguments properly
- * because I call parse on the input twice 
+ * note: each input line is parsed once (see parser.h) and
+ * the resulting list of pipelines is what gets dispatched
+ * and run
 *************************************************************/
 
 #include <stdio.h>
@@ -14,101 +15,359 @@
 #include <ctype.h>
 #include <string.h>
 #include <time.h>
-#include <iostream>
 #include <unistd.h>
-#include <boost/lexical_cast.hpp>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fcntl.h>
 #include <dirent.h>
 #include <sys/wait.h>
+#include <spawn.h>
+#include <sys/mman.h>
+#include <sys/sendfile.h>
+#include <errno.h>
+#include <map>
+#include <vector>
+#include <unordered_map>
 #include "stringlist.h"
 #include "lexer.h"
+#include "parser.h"
+#include "arena.h"
+#include "jobs.h"
+#include "events.h"
+#include "list.h"
+#include "walk.h"
+#include "output.h"
+#include "history.h"
+#include "builtins.h"
+#include "redirect.h"
+#include "vars.h"
 
 using namespace std;
 
 void intro();
 struct tm* getTimeStruct();
 void printCommands();
-string botAction(string);
-void botResponse(string, string, int);
+int runList(cmdlist *);
+int botResponse(pipeline *);
+string joinWords(char **);
 void getAnswer(string);
-void generateSleep(float);
+void generateSleep(float, pipeline *);
 void openFile(string);
 void closeFile(int);
-void listDirectory(string);
+void filesCommand(char **);
+bool copyToStdout(int);
+void readAll(int);
+int catFiles(char **);
+int countLines(char **);
 void getProcessAge();
 string readLine(int);
+int nextLine(struct lineReader &, string &);
+int runLine(const string &, int, struct lineSource *);
+bool moreLine(struct lineSource *, string &);
+bool readBodies(cmdlist *, struct lineSource *);
+int runScript(int);
+void syncReader(struct lineReader &);
+void initReader(struct lineReader &, int);
+void addFile(int, int, string);
+struct filesOpen *findFile(int);
 void time();
 int isFileExecutable(const char*);
-void execPath(string, int);
+int execPath(pipeline *);
+int forkCommand(command *, const redirPlan &, job *);
+int spawnCommand(command *, const redirPlan &, job *);
+void launchCommand(char **);
 bool checkFilePath(string);
-bool tryToExec(string program, string &input);
+bool tryToExec(command *);
+const char *lookupVar(const char *);
+char **commandEnvironment(command *);
+bool hashLookup(const string &program, string &path);
+void hashCommand(char **);
 
+// Buffered input state for one file descriptor. Bytes in
+// buf[start, end) have been read from the descriptor but not yet
+// handed out by nextLine().
+struct lineReader {
+   int fd;
+   char *buf;      //allocated on the first read
+   size_t cap;
+   size_t start;
+   size_t end;
+   int pollable;   //0 until we know, then 1 or -1 (see waitReadable)
+   off_t offset;   //bytes handed out so far
+   long lines;     //lines handed out so far
+   long fills;     //read() calls made to refill buf
+};
+
+// An entry in the descriptor table, which is what the file numbers
+// of open, read and close refer to. File 0 is always std in.
 struct filesOpen {
-   FILE *fp;
    string filename;
+   lineReader in;
+   struct stat info; //as of when the file was opened
+};
+
+#define READER_BUFSIZE 65536
+
+// Where the lines after the one being run come from, since the
+// bodies of here-documents are read from there.
+struct lineSource {
+   lineReader *reader; //the input being read,
+   const char *text;   //or for -c, what's left of the command (NULL at the end)
+   bool prompt;        //print "> " before asking for each line
+};
+
+// A directory from $PATH, along with its modification time as of
+// the last time we cached anything found in it.
+struct pathDir {
+   string name;
+   struct timespec mtime;
 };
 
-FILE *fp;
+// A remembered command location, as shown by the hash builtin.
+struct hashEntry {
+   string path;
+   int dir;
+   int hits;
+};
+
+#define DEFAULT_PATH "/usr/local/bin:/bin:/usr/bin"
+
+// How execPath() starts programs; see the launch builtin.
+enum launchMode { LAUNCH_SPAWN, LAUNCH_FORK };
+
 struct timespec boot;
+map<int, filesOpen> files; //file number -> open file
+string pathValue;
+vector<pathDir> pathDirs;
+unordered_map<string, hashEntry> commandHash;
+launchMode launcher = LAUNCH_SPAWN;
+arena cmdArena; //everything parsed from the current input line
+bool debug = false; //echo each line before running it (-x)
+bool execFinal = false; //nothing runs after the next pipeline, see execPath()
+int lastStatus = 0; //status of the last pipeline run, for $?
+pid_t shellPid; //for $$, which stays the same in subshells
 
 int main(int argc, char **argv) {
    clock_gettime(CLOCK_REALTIME, &boot);
-   setbuf(stdout, NULL);
+   arena_init(&cmdArena);
+   initOutput();
+   initVars();
+   shellPid = getpid();
+   addFile(0, 0, "std in");
+
+   //msh [-x] [-c command | script]
+   const char *command = NULL;
+   const char *script = NULL;
+   for (int i = 1; i < argc && script == NULL; i++) {
+      if (strcmp(argv[i], "-x") == 0) {
+	 debug = true;
+      } else if (strcmp(argv[i], "-c") == 0) {
+	 if (i + 1 >= argc) {
+	    fprintf(stderr, "msh: -c requires an argument\n");
+	    return 2;
+	 }
+	 command = argv[++i];
+	 break;
+      } else {
+	 script = argv[i];
+      }
+   }
+
+   //with -c or a script there are no banners, prompts or
+   //job chatter, and the shell exits with the last status
+   if (command != NULL || script != NULL) {
+      initEvents(false);
+      initJobs(false, false);
+      if (command != NULL) {
+	 int status = 0;
+	 lineSource more = { NULL, command, false };
+	 string s;
+	 while (moreLine(&more, s)) {
+	    execFinal = (more.text == NULL);
+	    status = runLine(s, status, &more);
+	 }
+	 return status;
+      }
+      int fd = open(script, O_RDONLY | O_CLOEXEC);
+      if (fd < 0) {
+	 fprintf(stderr, "msh: cannot open %s: %s\n", script, strerror(errno));
+	 return 127;
+      }
+      return runScript(fd);
+   }
+
+   initEvents(isatty(0));
+   initJobs(isatty(0), true);
+   initHistory(isatty(0));
    intro();
    printCommands();
-   bool debug = false;
-   if (argc > 1 && (strcmp(argv[1],"-x") == 0)) {
-      debug = true;
-   }
+   int status = 0;
+   lineSource more = { &files[0].in, NULL, true };
    while (true) {
+      notifyJobs();
       printf("What next? ");
-      string s = readLine(0);
-
-      if (debug) {
+      string s;
+      if (nextLine(files[0].in, s) <= 0) {
+	 printf("Cya later! :)\n");
+	 return status;
+      }
+      if (takeInterrupt()) {
+	 //^C at the prompt throws away the line and starts over
+	 printf("\n");
+	 continue;
+      }
+      if (s[0] == '!') {
+	 if (!expandHistory(s)) {
+	    status = 1;
+	    continue;
+	 }
+	 //show what is about to run, like other shells do
 	 printf("%s\n", s.c_str());
       }
+      addHistory(s);
+      status = runLine(s, status, &more);
+   }
 
-      int pipe = s.find("|", 0);
-      string execCheck = s.substr(0,2);
-      if (s == "quit") {
-	 printf("Cya later! :)\n");
-	 return 0;
-      } else if (s == "help") {
-	 printCommands();
-      } else if ((s == "how are you?") || (s == "how are you")) {
-	 printf("Great! Thanks for asking :)\n");
-      } else if ((execCheck == "./" || execCheck.substr(0,1) == "/") && (pipe < 0)) {	
-	 //exec without piping and direct paths
-	 execPath(s, pipe); 
-      } else if (( execCheck == "./" || execCheck.substr(0,1) == "/") && (pipe > 0)) { 
-	 //exec with piping and a direct path as the first arg
-	 string pipe2 = s.substr(pipe+2);
-	 string execCheck2 = pipe2.substr(0, 2);
-	 if ((execCheck2 == "./") || (execCheck2.substr(0,1) == "/")) {
-	    //direct path for the second arg
-	    execPath(s, pipe);
-	 } else {
-	    //find path for the second arg
-	    string prog = botAction(pipe2);
-	    if (!tryToExec(prog, pipe2)) {
-	       printf("error: second program does not exist\n");
-	    } else {
-	       string pipe1 = s.substr(0, pipe);
-	       string newStr = pipe1+" | "+pipe2;
-	       execPath(newStr, pipe);
-	    }
-	 }
-      } else {
+   return 0;
+}
+
+/************************************
+ * int runLine(const string &s, int, lineSource *)
+ * pre: s is one line of input and
+ * status that of the line before it;
+ * more is the rest of the input
+ * post: the line is parsed and run,
+ * and its exit status returned (a
+ * blank line keeps the old status);
+ * the bodies of its here-documents
+ * have been read from more
+ ***********************************/
+int runLine(const string &s, int status, lineSource *more) {
+   lastStatus = status;
+   if (debug) {
+      printf("%s\n", s.c_str());
+   }
+
+   if ((s == "how are you?") || (s == "how are you")) {
+      printf("Great! Thanks for asking :)\n");
+      return 0;
+   }
+   const char *errmsg;
+   cmdlist *l = parse_line(s.c_str(), &cmdArena, &errmsg);
+   if (l == NULL) {
+      printf("%s\n", errmsg);
+      status = 2;
+   } else if (!readBodies(l, more)) {
+      status = 1;
+   } else if (l->npipes > 0) {
+      status = runList(l);
+   }
+   arena_reset(&cmdArena);
+   return status;
+}
+
+/************************************
+ * int runScript(int fd)
+ * pre: fd is open on a script
+ * post: every line of the script is
+ * run in turn and the status of the
+ * last command returned
+ ***********************************/
+int runScript(int fd) {
+   int status = 0;
+   string s;
+   lineReader r;
+   initReader(r, fd);
+   lineSource more = { &r, NULL, false };
+   while (nextLine(r, s) > 0) {
+      status = runLine(s, status, &more);
+      //finished background jobs aren't reported, just cleared
+      notifyJobs();
+   }
+   return status;
+}
 
-	 string action = botAction(s);
-      
-	 botResponse(action,s, pipe);
+/************************************
+ * bool moreLine(lineSource *, string &)
+ * post: s holds the next line of the
+ * input, or false is returned at the
+ * end of it
+ ***********************************/
+bool moreLine(lineSource *more, string &s) {
+   if (more == NULL) {
+      return false;
+   }
+   if (more->reader == NULL) {
+      if (more->text == NULL) {
+	 return false;
       }
+      const char *nl = strchr(more->text, '\n');
+      s = (nl != NULL) ? string(more->text, nl - more->text) : string(more->text);
+      more->text = (nl != NULL) ? nl + 1 : NULL;
+      return true;
+   }
+   if (more->prompt) {
+      printf("> ");
    }
+   return nextLine(*more->reader, s) > 0;
+}
 
-   return 0;
+/************************************
+ * bool readBody(redirect *, lineSource *, arena *)
+ * pre: r is a here-document
+ * post: the lines up to its delimiter
+ * are read from more and become its
+ * body; false is returned if the
+ * input ended before the delimiter
+ ***********************************/
+static bool readBody(redirect *r, lineSource *more, arena *a) {
+   string body, s;
+   bool ended = false;
+   while (moreLine(more, s)) {
+      size_t skip = r->strip_tabs ? s.find_first_not_of('\t') : 0;
+      if (skip == string::npos) {
+	 skip = s.size();
+      }
+      if (s.compare(skip, string::npos, r->delim) == 0) {
+	 ended = true;
+	 break;
+      }
+      body.append(s, skip, string::npos);
+      body += '\n';
+   }
+   r->target = arena_strndup(a, body.data(), body.size());
+   if (!ended) {
+      printf("error: here-document wanted %s before the end of input\n", r->delim);
+   }
+   return ended;
+}
+
+/************************************
+ * bool readBodies(cmdlist *, lineSource *)
+ * pre: l was just parsed from a line
+ * of the input more comes from
+ * post: every here-document in l has
+ * its body, read in the order they
+ * appear; false is returned if any
+ * body was cut short
+ ***********************************/
+bool readBodies(cmdlist *l, lineSource *more) {
+   bool ok = true;
+   for (int i = 0; i < l->npipes; i++) {
+      pipeline *p = &l->pipes[i];
+      for (int j = 0; j < p->ncmds; j++) {
+	 command *cmd = &p->cmds[j];
+	 if (cmd->group != NULL) {
+	    ok = readBodies(cmd->group, more) && ok;
+	 }
+	 for (int k = 0; k < cmd->nredirs; k++) {
+	    if (cmd->redirs[k].type == REDIR_HEREDOC) {
+	       ok = readBody(&cmd->redirs[k], more, &cmdArena) && ok;
+	    }
+	 }
+      }
+   }
+   return ok;
 }
 
 
@@ -158,77 +417,317 @@ struct tm* getTimeStruct() {
  
 
 /***********************************
- * string botResponse()
- * pre: action and input are valid 
- * strings
+ * int runList(cmdlist *)
+ * pre: l is a parsed list
+ * post: each pipeline of the list is
+ * run in turn, skipping those an &&
+ * or || rules out; the status of the
+ * last one that ran is returned
+ **********************************/
+
+int runList(cmdlist *l) {
+   //only the last pipeline of a final list is final itself
+   bool final = execFinal;
+   execFinal = false;
+   int status = 0;
+   for (int i = 0; i < l->npipes; i++) {
+      pipeline *p = &l->pipes[i];
+      if ((p->op == LIST_AND && status != 0) || (p->op == LIST_OR && status == 0)) {
+	 continue;
+      }
+      execFinal = final && (i == l->npipes - 1);
+      status = botResponse(p);
+      execFinal = false;
+      lastStatus = status;
+   }
+   return status;
+}
+
+/***********************************
+ * the builtins
+ * pre: args are the words of the
+ * command (args[0] is its name) and
+ * p is the pipeline it came from
+ * post: the command is carried out
+ * and its exit status returned, or
+ * NOT_BUILTIN if it should be run as
+ * a program instead
+ **********************************/
+
+static int builtinQuit(char **args, pipeline *) {
+   if (jobMessages()) {
+      printf("Cya later! :)\n");
+   }
+   exit(args[1] != NULL ? atoi(args[1]) : 0);
+}
+
+static int builtinHelp(char **, pipeline *) {
+   printCommands();
+   return 0;
+}
+
+static int builtinSay(char **args, pipeline *) {
+   printf("%s\n", joinWords(args + 1).c_str());
+   return 0;
+}
+
+static int builtinTell(char **args, pipeline *) {
+   getAnswer(joinWords(args + 1));
+   return 0;
+}
+
+static int builtinSleep(char **args, pipeline *p) {
+   generateSleep(args[1] != NULL ? atof(args[1]) : 0, p);
+   return 0;
+}
+
+static int builtinList(char **args, pipeline *) {
+   return listCommand(args + 1);
+}
+
+static int builtinOpen(char **args, pipeline *) {
+   openFile(args[1] != NULL ? args[1] : "");
+   return 0;
+}
+
+static int builtinFiles(char **args, pipeline *) {
+   filesCommand(args + 1);
+   return 0;
+}
+
+static int builtinClose(char **args, pipeline *) {
+   closeFile(args[1] != NULL ? atoi(args[1]) : 0);
+   return 0;
+}
+
+static int builtinLaunch(char **args, pipeline *) {
+   launchCommand(args + 1);
+   return 0;
+}
+
+static int builtinJobs(char **args, pipeline *) {
+   jobsCommand(args + 1);
+   return 0;
+}
+
+static int builtinFg(char **args, pipeline *) {
+   return fgCommand(args + 1);
+}
+
+static int builtinBg(char **args, pipeline *) {
+   bgCommand(args + 1);
+   return 0;
+}
+
+static int builtinWait(char **args, pipeline *) {
+   waitCommand(args + 1);
+   return 0;
+}
+
+static int builtinKill(char **args, pipeline *) {
+   killCommand(args + 1);
+   return 0;
+}
+
+static int builtinHashCmd(char **args, pipeline *) {
+   hashCommand(args + 1);
+   return 0;
+}
+
+static int builtinRead(char **args, pipeline *) {
+   int desc = (args[1] != NULL) ? atoi(args[1]) : 0;
+   if (findFile(desc) == NULL) {
+      return 1;
+   }
+   if (args[1] != NULL && args[2] != NULL && strcmp(args[2], "all") == 0) {
+      readAll(desc);
+      return 0;
+   }
+   printf("Reading line from file %d:\n", desc);
+   printf("%s\n", readLine(desc).c_str());
+   return 0;
+}
+
+static int builtinCat(char **args, pipeline *p) {
+   //anything fancier than naming files (options, or "-" for
+   //std in) goes to the real cat
+   if (args[1] == NULL || p->cmds[0].nredirs != 0) {
+      return NOT_BUILTIN;
+   }
+   for (int i = 1; args[i] != NULL; i++) {
+      if (args[i][0] == '-') {
+	 return NOT_BUILTIN;
+      }
+   }
+   return catFiles(args + 1);
+}
+
+static int builtinCount(char **args, pipeline *) {
+   if (args[1] == NULL || strcmp(args[1], "lines") != 0) {
+      return NOT_BUILTIN;
+   }
+   return countLines(args + 2);
+}
+
+static int builtinHistory(char **args, pipeline *) {
+   return historyCommand(args + 1);
+}
+
+static int builtinSearch(char **args, pipeline *) {
+   return searchCommand(args + 1);
+}
+
+static int builtinFind(char **args, pipeline *p) {
+   if (p->cmds[0].nredirs != 0) {
+      return NOT_BUILTIN;
+   }
+   //-1 means options only the real find knows
+   int status = findCommand(args + 1);
+   return (status >= 0) ? status : NOT_BUILTIN;
+}
+
+static int builtinExport(char **args, pipeline *) {
+   return exportCommand(args + 1);
+}
+
+static int builtinUnset(char **args, pipeline *) {
+   return unsetCommand(args + 1);
+}
+
+// Every builtin; add new ones here.
+constexpr builtin builtins[] = {
+   {"quit", builtinQuit},
+   {"help", builtinHelp},
+   {"say", builtinSay},
+   {"tell", builtinTell},
+   {"sleep", builtinSleep},
+   {"list", builtinList},
+   {"open", builtinOpen},
+   {"files", builtinFiles},
+   {"close", builtinClose},
+   {"launch", builtinLaunch},
+   {"jobs", builtinJobs},
+   {"fg", builtinFg},
+   {"bg", builtinBg},
+   {"wait", builtinWait},
+   {"kill", builtinKill},
+   {"hash", builtinHashCmd},
+   {"read", builtinRead},
+   {"cat", builtinCat},
+   {"count", builtinCount},
+   {"history", builtinHistory},
+   {"search", builtinSearch},
+   {"find", builtinFind},
+   {"export", builtinExport},
+   {"unset", builtinUnset},
+};
+
+constexpr builtinTable builtinIndex = makeBuiltinTable(builtins);
+
+/***********************************
+ * int botResponse(pipeline *)
+ * pre: p is a parsed pipeline
  * post: a response will be generated
- * based on the action and input
+ * based on the first word of the
+ * command, or the pipeline will be
+ * executed if it isn't a builtin;
+ * its exit status is returned
  **********************************/
 
-void botResponse(string action, string input, int pipe) {
-
-   if (action == "say") { 
-      printf("%s\n", input.substr(4).c_str());
-   } else if (action == "tell") {
-      getAnswer(input.substr(5));
-   } else if (action == "sleep") {
-      double num = atof(input.substr(6).c_str());
-      generateSleep(num);
-   } else if (action == "list") {
-      listDirectory(input.substr(5));
-   } else if (action == "open") {
-      openFile(input.substr(5));
-   } else if (action == "close") {
-      closeFile(atoi(input.substr(6).c_str()));
-   } else if (action == "read") {
-      int desc = atoi(input.substr(5).c_str());
-      printf("Reading line from file %d:\n", desc);
-      printf("%s\n", readLine(desc).c_str());
-   } else {
+int botResponse(pipeline *p) {
 
-      if (pipe < 0) {
-	 if(!tryToExec(action, input)) {
-	    //check for a path and see if it's executable
-	    printf("Sorry I don't know how to do that!\n"); 
-	 } else {
-	    execPath(input, pipe);
+   for (int i = 0; i < p->ncmds; i++) {
+      expand_command(&p->cmds[i], &cmdArena, lookupVar);
+   }
+   command *first = &p->cmds[0];
+   char **args = first->argv;
+
+   if (p->ncmds == 1 && first->group == NULL && args[0] == NULL) {
+      //only NAME=value words, which set shell variables; any
+      //redirections are still done (creating files, or failing)
+      for (int i = 0; first->assigns[i] != NULL; i++) {
+	 setVar(first->assigns[i]);
+      }
+      if (first->nredirs == 0) {
+	 return 0;
+      }
+      redirPlan plan;
+      vector<fdSave> saved;
+      int status = 1;
+      flushOutput();
+      if (planRedirects(first, -1, -1, plan) && shellRedirects(plan, saved)) {
+	 status = 0;
+      }
+      flushOutput();
+      restoreDescriptors(saved);
+      releaseRedirects(plan);
+      return status;
+   }
+
+   if (p->ncmds == 1 && first->group != NULL && !first->subshell &&
+       !p->background && first->nredirs == 0) {
+      //a { } group runs right here in the shell
+      return runList(first->group);
+   } else if (p->ncmds == 1 && first->group == NULL && args[0] != NULL) {
+      //only a lone command can be a builtin, pipelines and
+      //other groups always run as processes
+      const builtin *b = findBuiltin(builtinIndex, builtins, args[0]);
+      if (b != NULL && first->nredirs == 0) {
+	 int status = b->run(args, p);
+	 if (status != NOT_BUILTIN) {
+	    return status;
 	 }
-      } else {
-	 //try to exec both sides
-	 string prog1 = input.substr(0, pipe);
-	 string prog2 = input.substr(pipe+2);
-	 string action1 = botAction(prog1);
-	 string action2 = botAction(prog2);
-	 bool left = tryToExec(action1, prog1);
-	 bool right = true;
-	 if (!(action2.substr(0, 2) == "./" || (action2.substr(0, 1) == "/"))) {
-	      right = tryToExec(action2, prog2);
+      } else if (b != NULL) {
+	 //the builtin's redirections are done in the shell
+	 //itself, and undone once it returns
+	 redirPlan plan;
+	 vector<fdSave> saved;
+	 int status = 1;
+	 flushOutput();
+	 if (planRedirects(first, -1, -1, plan) && shellRedirects(plan, saved)) {
+	    status = b->run(args, p);
 	 }
-	 if (!(left && right)) {
-	    printf("error: cannot exec both of these programs\n");
-	 } else {
-	    execPath(prog1+" | "+prog2, pipe);
+	 flushOutput();
+	 restoreDescriptors(saved);
+	 releaseRedirects(plan);
+	 if (status != NOT_BUILTIN) {
+	    return status;
 	 }
-	 
       }
    }
 
+   //find a path for every program in the pipeline
+   for (int i = 0; i < p->ncmds; i++) {
+      if (p->cmds[i].group == NULL && !tryToExec(&p->cmds[i])) {
+	 if (p->ncmds > 1) {
+	    printf("error: cannot exec %s\n", (p->cmds[i].argv[0] != NULL) ?
+		   p->cmds[i].argv[0] : "an empty command");
+	 } else if (args[0] != NULL && strchr(args[0], '/') != NULL) {
+	    printf("invalid filename!\n");
+	 } else {
+	    printf("Sorry I don't know how to do that!\n"); 
+	 }
+	 return 127;
+      }
+   }
+   return execPath(p);
 }
 	  
 /***********************************
- * string botAction()
- * pre: input is a valid string
- * post: the first word in input
- * will be returned
+ * string joinWords(char **words)
+ * pre: words is NULL terminated
+ * post: the words will be returned
+ * separated by single spaces
  **********************************/
-string botAction(string input) {
-   string a = "";
-   int ct = 0;
-   while (input[ct] != ' ') {
-      a += input[ct];
-      ct++;
+string joinWords(char **words) {
+   string s = "";
+   for (int i = 0; words[i] != NULL; i++) {
+      if (i != 0) {
+	 s += ' ';
+      }
+      s += words[i];
    }
-   return a;
+   return s;
 }
 
 /***********************************
@@ -263,14 +762,36 @@ void getAnswer(string input) {
 /***********************************
  * string generateSleep()
  * pre: num is a valid float
- * post: sleeps the thread for num 
- * seconds
+ * post: sleeps for num seconds, or
+ * with a trailing & starts a timer
+ * job and returns straight away
+ * note: either way the event loop
+ * keeps running, so children are
+ * reaped and ^C is noticed meanwhile
  **********************************/
-void generateSleep(float num) {
-   printf("Going to sleep for %f seconds\n", num);
-   usleep(num*1000000);
-   printf("OK that was a nice nap!");
-  
+void generateSleep(float num, pipeline *p) {
+   if (p->background) {
+      job *j = newTimerJob(p->text, num);
+      if (j == NULL) {
+	 printf("error: could not start a timer: %s\n", strerror(errno));
+	 return;
+      }
+      if (jobMessages()) {
+	 printf("[%d] Going to sleep for %f seconds in the background\n", j->id, num);
+      }
+      return;
+   }
+   if (jobMessages()) {
+      printf("Going to sleep for %f seconds\n", num);
+   }
+   if (sleepFor(num)) {
+      if (jobMessages()) {
+	 printf("OK that was a nice nap!\n");
+      }
+   } else {
+      takeInterrupt();
+      printf("\nNap interrupted!\n");
+   }
 }
 
 /***********************************
@@ -288,45 +809,267 @@ void getProcessAge() {
 
 }
 
-/***********************************
- * string listDirectory(string)
- * pre: dirName is a valid string
- * post: the directories in dirName
- * will be printed 
- **********************************/
-void listDirectory(string dirName) {
-   if (dirName == "") {
-      printf("Please enter a valid directory\n");
-   } else {
-      DIR *dp = NULL;
-      struct dirent *dptr = NULL;
-      if ((dp = opendir(dirName.c_str())) == NULL) {
-	 printf("Error: Can't open directory\n");
-      }
-      printf("The contents of the directory are: \n");
-      while((dptr = readdir(dp)) != NULL) {
-	 printf("%s\n", dptr->d_name);
-      }
-      closedir(dp);
-   }
-}
-
 /***********************************
  * string openFile(string)
  * pre: filename is a valid string
- * post: the file will be opened
- * and its file number will be printed
+ * post: the file will be opened,
+ * added to the descriptor table under
+ * the lowest free file number, and
+ * that number will be printed
  **********************************/
 void openFile(string filename) {
    if (filename == "") {
       printf("Error - there is no filename\n");
+      return;
    }
-   int desc = open(filename.c_str(), 0);
+   //the shell's own descriptors are never passed to programs
+   int desc = open(filename.c_str(), O_RDONLY | O_CLOEXEC);
    if (desc == -1) {
       printf("Error - could not open file\n");
-   } else {
-      printf("OK, I Opened file %d\n", desc);
+      return;
+   }
+   int id = 1;
+   while (files.count(id)) {
+      id++;
    }
+   addFile(id, desc, filename);
+   printf("OK, I Opened file %d\n", id);
+}
+
+/***********************************
+ * void addFile(int id, int fd, string)
+ * pre: fd is open and id is unused
+ * post: fd is in the descriptor
+ * table as file number id
+ **********************************/
+void addFile(int id, int fd, string filename) {
+   filesOpen &f = files[id];
+   f.filename = filename;
+   initReader(f.in, fd);
+   if (fstat(fd, &f.info) < 0) {
+      memset(&f.info, 0, sizeof(f.info));
+   }
+}
+
+/***********************************
+ * filesOpen *findFile(int id)
+ * post: the table entry for file
+ * number id is returned, or NULL
+ * after printing an error
+ **********************************/
+filesOpen *findFile(int id) {
+   map<int, filesOpen>::iterator it = files.find(id);
+   if (it == files.end()) {
+      printf("There is no file %d open\n", id);
+      return NULL;
+   }
+   return &it->second;
+}
+
+/***********************************
+ * void filesCommand(char **args)
+ * post: every entry of the descriptor
+ * table is listed, with how far it
+ * has been read
+ **********************************/
+void filesCommand(char **) {
+   printf("FILE  FD  %10s  %8s  %8s  %6s  %10s  NAME\n",
+	  "OFFSET", "BUFFERED", "LINES", "READS", "SIZE");
+   for (map<int, filesOpen>::iterator it = files.begin(); it != files.end(); ++it) {
+      filesOpen &f = it->second;
+      lineReader &r = f.in;
+      char size[32] = "-";
+      if (S_ISREG(f.info.st_mode)) {
+	 snprintf(size, sizeof(size), "%lld", (long long)f.info.st_size);
+      }
+      printf("%4d  %2d  %10lld  %8zu  %8ld  %6ld  %10s  %s\n", it->first, r.fd,
+	     (long long)r.offset, r.end - r.start, r.lines, r.fills, size,
+	     f.filename.c_str());
+   }
+}
+
+/***********************************
+ * bool copyToStdout(int fd)
+ * pre: fd is open for reading
+ * post: everything from fd's current
+ * offset to its end is written to
+ * std out; false is returned if
+ * reading or writing failed
+ * note: the data is moved by the
+ * kernel with sendfile (or splice
+ * for a pipe), so it never passes
+ * through our memory; plain read and
+ * write are only the last resort
+ **********************************/
+bool copyToStdout(int fd) {
+   //anything we printf'd has to come out first
+   flushOutput();
+
+   const size_t chunk = 1 << 30;
+   ssize_t n;
+   while ((n = sendfile(1, fd, NULL, chunk)) > 0) {
+   }
+   if (n == 0) {
+      return true;
+   }
+   if (errno == EINVAL || errno == ENOSYS) {
+      while ((n = splice(fd, NULL, 1, NULL, chunk, SPLICE_F_MOVE)) > 0) {
+      }
+      if (n == 0) {
+	 return true;
+      }
+   }
+   if (errno != EINVAL && errno != ENOSYS) {
+      return false;
+   }
+
+   char buf[READER_BUFSIZE];
+   while ((n = read(fd, buf, sizeof(buf))) > 0) {
+      for (ssize_t done = 0; done < n; ) {
+	 ssize_t w = write(1, buf + done, n - done);
+	 if (w < 0) {
+	    return false;
+	 }
+	 done += w;
+      }
+   }
+   return n == 0;
+}
+
+/***********************************
+ * void readAll(int desc)
+ * pre: desc is a file number from
+ * the open command
+ * post: the rest of the file (from
+ * where read left off) is printed
+ **********************************/
+void readAll(int desc) {
+   filesOpen *f = findFile(desc);
+   if (f == NULL) {
+      return;
+   }
+   printf("Reading the rest of file %d:\n", desc);
+
+   //lines read ahead but not handed out yet come first
+   lineReader &r = f->in;
+   fwrite(r.buf + r.start, 1, r.end - r.start, stdout);
+   r.offset += r.end - r.start;
+   r.start = r.end = 0;
+   off_t before = lseek(r.fd, 0, SEEK_CUR);
+   if (!copyToStdout(r.fd)) {
+      printf("There was a problem reading from file %d: %s\n", desc, strerror(errno));
+   }
+   off_t after = lseek(r.fd, 0, SEEK_CUR);
+   if (before >= 0 && after >= before) {
+      r.offset += after - before;
+   }
+}
+
+/***********************************
+ * void catError(const char *name)
+ * post: cat's message for the file
+ * and errno is printed on std err,
+ * after everything already printed
+ **********************************/
+static void catError(const char *name) {
+   int err = errno;
+   flushOutput();
+   fprintf(stderr, "cat: %s: %s\n", name, strerror(err));
+}
+
+/***********************************
+ * int catFiles(char **names)
+ * pre: names is NULL terminated
+ * post: each named file is printed
+ * in turn; one that can't be is
+ * reported on std err, as cat does,
+ * and 1 is returned, 0 otherwise
+ **********************************/
+int catFiles(char **names) {
+   int status = 0;
+   for (int i = 0; names[i] != NULL; i++) {
+      int fd = open(names[i], O_RDONLY | O_CLOEXEC);
+      if (fd < 0) {
+	 catError(names[i]);
+	 status = 1;
+	 continue;
+      }
+      if (!copyToStdout(fd)) {
+	 catError(names[i]);
+	 status = 1;
+      }
+      close(fd);
+   }
+   return status;
+}
+
+/***********************************
+ * long countFile(int fd)
+ * pre: fd is open for reading
+ * post: the number of newlines in the
+ * file is returned, or -1 on error
+ * note: a regular file is mapped and
+ * scanned in place; anything else is
+ * read through a buffer
+ **********************************/
+long countFile(int fd) {
+   long lines = 0;
+   struct stat st;
+   if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+      void *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+      if (map != MAP_FAILED) {
+	 madvise(map, st.st_size, MADV_SEQUENTIAL);
+	 const char *p = (const char *)map;
+	 const char *end = p + st.st_size;
+	 while ((p = (const char *)memchr(p, '\n', end - p)) != NULL) {
+	    lines++;
+	    p++;
+	 }
+	 munmap(map, st.st_size);
+	 return lines;
+      }
+   }
+
+   char buf[READER_BUFSIZE];
+   ssize_t n;
+   while ((n = read(fd, buf, sizeof(buf))) > 0) {
+      const char *p = buf;
+      const char *end = buf + n;
+      while ((p = (const char *)memchr(p, '\n', end - p)) != NULL) {
+	 lines++;
+	 p++;
+      }
+   }
+   return (n == 0) ? lines : -1;
+}
+
+/***********************************
+ * int countLines(char **names)
+ * pre: names is NULL terminated
+ * post: the number of lines in each
+ * named file is printed; 1 is returned
+ * if any of them couldn't be read
+ **********************************/
+int countLines(char **names) {
+   if (names[0] == NULL) {
+      printf("Please enter a filename\n");
+      return 1;
+   }
+   int status = 0;
+   for (int i = 0; names[i] != NULL; i++) {
+      int fd = open(names[i], O_RDONLY | O_CLOEXEC);
+      long lines = (fd < 0) ? -1 : countFile(fd);
+      if (lines < 0) {
+	 printf("count: %s: %s\n", names[i], strerror(errno));
+	 status = 1;
+      } else {
+	 printf("%ld lines in %s\n", lines, names[i]);
+      }
+      if (fd >= 0) {
+	 close(fd);
+      }
+   }
+   return status;
 }
 
 
@@ -334,10 +1077,22 @@ void openFile(string filename) {
 /***********************************
  * string closeFile(int desc)
  * pre: desc is a valid int
- * post: the file will be closed
+ * post: the file will be closed and
+ * its buffered input thrown away
  **********************************/
 void closeFile(int desc) {
-   if (close(desc) == -1) {
+   if (desc == 0) {
+      printf("Error could not close file %d\n", desc);
+      return;
+   }
+   filesOpen *f = findFile(desc);
+   if (f == NULL) {
+      return;
+   }
+   free(f->in.buf);
+   int fd = f->in.fd;
+   files.erase(desc);
+   if (close(fd) == -1) {
       printf("Error could not close file %d\n", desc);
    } else {
       printf("File %d closed\n", desc);
@@ -355,35 +1110,145 @@ void printCommands() {
    printf(" how are you?\n tell me the time\n tell me your name\n");
    printf(" tell me your age\n tell me your id\n tell me your parent's id\n");
    printf(" say [any phrase]\n sleep [amount of time]\n open [filename]\n");
-   printf(" read [file number]\n I can also execute any program!\n close [file number]\n quit\n");
+   printf(" list [-l] [-R] [-U] [directory ...]\n");
+   printf(" find [directory ...] [-name pattern] [-type f|d|l] [-threads n] [-count]\n");
+   printf(" read [file number] [all]\n cat [filename ...]\n count lines [filename ...]\n I can also execute any program!\n close [file number]\n files\n");
+   printf(" NAME=value [command]\n export [NAME[=value] ...]\n unset [NAME ...]\n");
+   printf(" Words with *, ? or [...] in them (and ** for any depth of directories) become the file names they match\n");
+   printf(" history [count]\n search [text]\n !! or !number or !-number or !prefix or !?text (run an earlier line again)\n");
+   printf(" jobs\n fg [%%n]\n bg [%%n]\n wait [%%n]\n kill [-signal] %%n\n");
+   printf(" hash [-r]\n launch [spawn|fork]\n quit [status]\n");
 }
 
 /********************************
- * string readLine(int fd)
- * pre: fd is a file descriptor 
- * that is currently open
+ * string readLine(int desc)
+ * pre: desc is a file number
+ * from the open command
  * post: a line will be read 
- * from the given file 
- * descriptor and returned 
+ * from the given file and
+ * returned, or a message printed
+ * if there is nothing left to
+ * read
+ *******************************/
+
+string readLine(int desc) {
+   string s;
+   filesOpen *f = findFile(desc);
+   if (f == NULL) {
+      return s;
+   }
+   int n = nextLine(f->in, s);
+   if (n == 0) {
+      printf("There is no more data available in file %d\n", desc);
+   } else if (n < 0) {
+      printf("There was a problem reading from file %d: error number %d\n", desc, errno);
+   }
+   return s;
+}
+
+/********************************
+ * void initReader(lineReader &, int fd)
+ * pre: fd is open for reading
+ * post: r reads from fd, with an
+ * empty buffer
+ *******************************/
+void initReader(lineReader &r, int fd) {
+   memset(&r, 0, sizeof(r));
+   r.fd = fd;
+}
+
+/********************************
+ * int nextLine(lineReader &r, string &s)
+ * pre: r was set up by initReader()
+ * post: the next line from r is
+ * stored in s (without its
+ * newline) and 1 returned; at the
+ * end of the input 0 is returned,
+ * and -1 on a read error
+ * note: input is read in large
+ * chunks and kept in r, so
+ * repeated calls on the same
+ * reader are served from memory; while
+ * waiting for more input the event
+ * loop runs, and a ^C makes this
+ * return early with an empty line
  *******************************/
 
-string readLine(int fd) {
-    string s = "";
-    while (true) {
-        char c;
-        int n = read(fd, &c, 1);
-        if (n == 0) {
-            printf("There is no more data available in file %d\n", fd);
-            return s;
-        } else if (n < 0) {
-            printf("There was a problem reading from file %d: error number %d\n", fd, n);
-            return s;
-        } else if (c == '\n') {
-            return s;
-        } else { 
-            s = s + c;
-        }
-    }
+int nextLine(lineReader &r, string &s) {
+   if (r.buf == NULL) {
+      r.cap = READER_BUFSIZE;
+      r.buf = (char *)malloc(r.cap);
+      r.start = r.end = 0;
+   }
+   size_t scanned = r.start;
+   while (true) {
+      char *nl = (char *)memchr(r.buf + scanned, '\n', r.end - scanned);
+      if (nl != NULL) {
+	 s.assign(r.buf + r.start, nl - (r.buf + r.start));
+	 r.offset += (nl - r.buf) + 1 - r.start;
+	 r.lines++;
+	 r.start = (nl - r.buf) + 1;
+	 return 1;
+      }
+
+      //no newline buffered yet, make room and refill
+      if (r.start > 0) {
+	 memmove(r.buf, r.buf + r.start, r.end - r.start);
+	 r.end -= r.start;
+	 r.start = 0;
+      }
+      scanned = r.end;
+      if (r.end == r.cap) {
+	 r.cap *= 2;
+	 r.buf = (char *)realloc(r.buf, r.cap);
+      }
+      if (r.pollable >= 0) {
+	 int ready = waitReadable(r.fd);
+	 if (ready == 0) {
+	    s.clear();
+	    return 1;
+	 }
+	 r.pollable = ready;
+      }
+      //whoever is about to type has to see what came before
+      flushOutput();
+      int n = read(r.fd, r.buf + r.end, r.cap - r.end);
+      r.fills++;
+      if (n < 0 && (errno == EINTR || errno == EAGAIN)) {
+	 continue;
+      }
+      if (n <= 0) {
+	 //a last line without a newline still counts
+	 s.assign(r.buf + r.start, r.end - r.start);
+	 r.offset += r.end - r.start;
+	 r.start = r.end = 0;
+	 if (!s.empty()) {
+	    r.lines++;
+	    return 1;
+	 }
+	 return (n == 0) ? 0 : -1;
+      }
+      r.end += n;
+   }
+}
+
+/********************************
+ * void syncReader(lineReader &r)
+ * pre: r was set up by initReader()
+ * post: any input buffered in r
+ * but not yet returned by nextLine()
+ * is given back to the descriptor
+ * (when it is seekable) so that a
+ * child sharing it sees it
+ *******************************/
+void syncReader(lineReader &r) {
+   if (r.end > r.start) {
+      if (lseek(r.fd, -(off_t)(r.end - r.start), SEEK_CUR) < 0) {
+	 //pipes and terminals can't be rewound, keep the data
+	 return;
+      }
+      r.start = r.end = 0;
+   }
 }
 
 /********************************************
@@ -407,183 +1272,223 @@ int isFileExecutable(const char *filename) {
 
 
 /********************************************
- * void execPath(string, p)
- * pre: path is a valid string
- * p is the correct index ofwhere the pipe is
- * if there is one in the path
- * input redirection is first 
- * output redirection is second
- * post: the program(s) in the path will be 
- * executed 
+ * int execPath(pipeline *p)
+ * pre: p holds one or more commands joined
+ * by pipes, and each is a group or argv[0]
+ * of it is the full path of an executable
+ * post: the programs in the pipeline will 
+ * be executed together as one job, each
+ * with its redirections; the exit status
+ * of the last one (0 in the background)
+ * is returned
  *******************************************/
-void execPath(string path, int p) {
+int execPath(pipeline *p) {
    
-   bool piped = false;
-   if (p > 0) {
-      piped = true;
-   }
-
-   char **words = split_words(path.c_str());
-   bool inBack = false;
-   bool outFile = false;
-   bool inFile = false;
-            
-   if (checkFilePath(words[0])) {
-  
-      if (strcmp(words[stringlist_len(words)-1], "&") == 0) {
-	 inBack = true;
-	 words = stringlist_copy(words, 0, stringlist_len(words)-1);
-      }
-    
-      int arrow1;
-      int arrow2;
-      int inArrow;
-      string inFilename = "";
-      string outFilename = "";
-      if (stringlist_len(words) >= 3)  {
-	 arrow1 = strcmp(words[stringlist_len(words)-2], ">");
-	 arrow2 = strcmp(words[stringlist_len(words)-2], ">>");
-	 inArrow = strcmp(words[stringlist_len(words)-2], "<");
-	 
-	 //output redirection 
-	 if (arrow1 == 0 || arrow2 == 0) {
-	    outFile = true;
-	    outFilename = words[stringlist_len(words)-1];
-	    words = stringlist_copy(words, 0, stringlist_len(words)-2);
-	 } else if ((inArrow == 0) && !outFile) {
-	    //input redirection and no output redirection
-	    inFile = true;
-	    inFilename = words[stringlist_len(words)-1];
-	    words = stringlist_copy(words, 0, stringlist_len(words)-2);
-	   
-	 } 
-	 if ((stringlist_len(words) >= 3) && !(outFile && inFile)) {
-	    //check for input redirection on top of an output redirection
-	    inArrow = strcmp(words[stringlist_len(words)-2], "<");	       
-	    if (inArrow == 0) {
-	       inFile = true;
-	       inFilename = words[stringlist_len(words)-1];
-	       words = stringlist_copy(words, 0, stringlist_len(words)-2);
-	    }
-	 }
+   int n = p->ncmds;
+
+   //children write straight to std out, and a forked child
+   //would print our buffer a second time
+   flushOutput();
+
+   if (execFinal && n == 1 && !p->background && p->cmds[0].group == NULL) {
+      //the shell would only wait for this and exit with its
+      //status, so skip the fork and become the program instead
+      resetChildSignals();
+      redirPlan plan;
+      if (!planRedirects(&p->cmds[0], -1, -1, plan) || !applyRedirects(plan)) {
+	 exit(1);
       }
-      
-      int fd[2];
-      char **word2 = stringlist_empty();
-      if (piped) {
-	 char **words1 = stringlist_empty();
-	 bool done = false;
-	 int i;
-	 for (i = 0; (i < stringlist_len(words) && !done); i++) {
-	    stringlist_append(&words1, words[i]);
-	    if (strcmp(words[i+1], "|") == 0) {
-	       done = true;	       
-	    }
-	 }
-	 //second exec 
-	 word2 = stringlist_copy(words, i+1, stringlist_len(words));
-	 //first exec 
-	 words = stringlist_copy(words1, 0, stringlist_len(words1));
-	 
-	 //create the pipe
-	 pipe(fd);
-      }
-	
-	    
-      //fork one child
-      int child = fork();
-      if (child == 0) {
-
-	 //redirection for pipe
-	 if (piped) {
-	    close(1); //closing std out 
-	    close(fd[0]);
-	    dup2(fd[1], 1);
-	    close(fd[1]);
-	 }
+      execve(p->cmds[0].argv[0], p->cmds[0].argv, commandEnvironment(&p->cmds[0]));
+      printf("error: could not exec %s\n", p->cmds[0].argv[0]);
+      exit(127);
+   }
+   job *j = newJob(p->text, p->background);
 
-	 //can only have output redirection if not piped
-	 if (outFile  && !piped) {
-	    int desc;
-	    if (arrow1 == 0) {
-	       desc = open(outFilename.c_str(), O_CREAT | O_RDWR | O_TRUNC, 0660);
-	    } else {
-	       desc = open(outFilename.c_str(), O_CREAT | O_RDWR | O_APPEND, 0660);
-	    }
-	    close(1);
-	    dup2(desc, 1);
-	    close(desc);
-	 } 
-
-	 //input redirection
-	 if (inFile) {
-	    int desc = open(inFilename.c_str(), 0); 
-	    if (desc < 0) {
-	       printf("error: can't open file\n");
-	       return;
-	    }
-	    close(0);
-	    dup2(desc, 0);
-	    close(desc);
-	 }
-	 execv(words[0], words);
-      }
-      
-      //create second child for pipe
-      int child2;
-      if (piped) {
-	 child2 = fork();
-
-	 //this pipe can only have output redirection
-	 if (child2 == 0) { //changing std in for pipe
-	    close(0);
-	    close(fd[1]);
-	    dup2(fd[0], 0);
-	    close(fd[0]);
-
-	    if (outFile) {
-	       int desc;
-	       if (arrow1 == 0) {
-		  desc = open(outFilename.c_str(), O_CREAT | O_RDWR | O_TRUNC | S_IWUSR | S_IRUSR, 0660);
-	       } else {
-		  desc = open(outFilename.c_str(), O_CREAT | O_APPEND | O_RDWR | S_IWUSR | S_IRUSR, 0660);
-	       }
-
-	       close(1);
-	       dup2(desc, 1);
-	       close(desc);
-	    } 
-	    execv(word2[0], word2);
-	 }
+   //let the children see any script input we haven't consumed
+   syncReader(files[0].in);
+
+   //each child gets the read end of the previous pipe as std in
+   //and the write end of the next pipe as std out; the pipes are
+   //close-on-exec so no child holds an end it doesn't use
+   int prevRead = -1;
+   int failed = 127; //status if nothing could be started
+   for (int i = 0; i < n; i++) {
+      int fd[2] = { -1, -1 };
+      if (i < n - 1 && pipe2(fd, O_CLOEXEC) < 0) {
+	 printf("error: could not create pipe\n");
+	 break;
+      }
+
+      //a group needs a copy of the shell to run it, so it
+      //can't be spawned
+      int child = -1;
+      redirPlan plan;
+      if (!planRedirects(&p->cmds[i], prevRead, fd[1], plan)) {
+	 //nothing to start, and a redirection failing is
+	 //status 1 (as in the child), not command not found
+	 failed = 1;
+      } else if (launcher == LAUNCH_SPAWN && p->cmds[i].group == NULL) {
+	 child = spawnCommand(&p->cmds[i], plan, j);
+      } else {
+	 child = forkCommand(&p->cmds[i], plan, j);
       }
+      releaseRedirects(plan);
 
-      if (piped) { //parent closes access to pipe
-	 close(fd[0]);
+      //parent closes its copies so EOF reaches the readers
+      if (prevRead >= 0) {
+	 close(prevRead);
+      }
+      if (fd[1] >= 0) {
 	 close(fd[1]);
       }
+      prevRead = fd[0];
+      if (child < 0) {
+	 break;
+      }
+      addProcess(j, child);
+   }
+   if (prevRead >= 0) {
+      close(prevRead);
+   }
 
-      //running in background
-      if (!inBack) {
-	 int status;
-	 waitpid(child, &status, 0);
-	 printf("Process %d finished with status %d\n", child, status);
-	 int status2;
-	 if (piped) {
-	    waitpid(child2, &status2, 0);
-	    printf("Process %d finished with status %d\n", child2, status2);
-	 }	 
-	 
-      } else {
-	 printf("Process %d run in background\n", child);
-	 if (piped) {
-	    printf("Process %d run in background\n", child2);
+   //running in background
+   if (j->pids.empty()) {
+      forgetJob(j);
+      return failed;
+   } else if (!p->background) {
+      return waitForJob(j);
+   }
+   if (!jobMessages()) {
+      return 0;
+   }
+   printf("[%d] %d\n", j->id, j->pids.back());
+   for (int i = 0; i < (int)j->pids.size(); i++) {
+      printf("Process %d run in background\n", j->pids[i]);
+   }
+   return 0;
+}
+
+/********************************************
+ * int forkCommand(command *, const redirPlan &, job *)
+ * pre: argv[0] of cmd is the full path of an
+ * executable, or cmd is a group; plan sets up
+ * its pipe ends and redirections (see
+ * redirect.h); cmd is the next process of
+ * job j
+ * post: cmd is started with fork and execv (a
+ * group is run by the forked copy of the
+ * shell instead) and its pid is returned, or
+ * -1 on failure
+ *******************************************/
+int forkCommand(command *cmd, const redirPlan &plan, job *j) {
+   int child = fork();
+   if (child == 0) {
+      //join the job's group and take the terminal while SIGTTOU
+      //is still ignored, since the group isn't in the foreground
+      //yet; only then go back to default signal handling (the
+      //same order posix_spawn uses in spawnCommand())
+      if (jobControlEnabled()) {
+	 setpgid(0, j->pgid);
+	 if (!j->background) {
+	    tcsetpgrp(0, getpgrp());
 	 }
       }
-   } else {
-      printf("invalid filename!\n");
+      resetChildSignals();
+      if (!applyRedirects(plan)) {
+	 flushOutput();
+	 _exit(1);
+      }
+      if (cmd->group != NULL) {
+	 enterSubshell();
+	 int status = runList(cmd->group);
+	 flushOutput();
+	 _exit(status);
+      }
+      execve(cmd->argv[0], cmd->argv, commandEnvironment(cmd));
+      printf("error: could not exec %s\n", cmd->argv[0]);
+      flushOutput();
+      _exit(127);
    }
+   if (child < 0) {
+      printf("error: could not fork\n");
+   }
+   return child;
 }
 
+/********************************************
+ * int spawnCommand(command *, const redirPlan &, job *)
+ * pre: same as forkCommand()
+ * post: cmd is started with posix_spawn, which
+ * shares our address space until the exec
+ * instead of copying page tables; pipe ends and
+ * redirections become spawn file actions, and
+ * the job's process group and signal defaults
+ * become spawn attributes; the pid is returned,
+ * or -1 on failure; if the spawn fails with
+ * pipe ends or redirections to set up, cmd is
+ * started with forkCommand() instead
+ *******************************************/
+int spawnCommand(command *cmd, const redirPlan &plan, job *j) {
+   posix_spawnattr_t attr;
+   posix_spawnattr_init(&attr);
+   sigset_t defaults, none;
+   childSignalDefaults(&defaults);
+   sigemptyset(&none);
+   posix_spawnattr_setsigdefault(&attr, &defaults);
+   posix_spawnattr_setsigmask(&attr, &none);
+   short flags = POSIX_SPAWN_SETSIGDEF | POSIX_SPAWN_SETSIGMASK;
+   if (jobControlEnabled()) {
+      flags |= POSIX_SPAWN_SETPGROUP;
+      posix_spawnattr_setpgroup(&attr, j->pgid);
+   }
+   posix_spawnattr_setflags(&attr, flags);
+
+   posix_spawn_file_actions_t actions;
+   posix_spawn_file_actions_init(&actions);
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || __GLIBC_MINOR__ >= 35)
+   if (jobControlEnabled() && !j->background) {
+      posix_spawn_file_actions_addtcsetpgrp_np(&actions, 0);
+   }
+#endif
+   spawnRedirects(plan, &actions);
+
+   pid_t child;
+   int err = posix_spawn(&child, cmd->argv[0], &actions, &attr, cmd->argv,
+			 commandEnvironment(cmd));
+   posix_spawn_file_actions_destroy(&actions);
+   posix_spawnattr_destroy(&attr);
+   if (err != 0 && !plan.steps.empty()) {
+      //the error doesn't say whether a redirection or the exec
+      //failed; a fork does the steps one by one and reports
+      //the one that went wrong (a file that can't be opened
+      //gets status 1, not 127)
+      return forkCommand(cmd, plan, j);
+   } else if (err != 0) {
+      printf("error: could not start %s: %s\n", cmd->argv[0], strerror(err));
+      return -1;
+   }
+   return child;
+}
+
+/********************************************
+ * void launchCommand(char **args)
+ * pre: args are the words after "launch"
+ * post: with no args the current way of
+ * starting programs is printed, otherwise
+ * it is switched to spawn or fork
+ *******************************************/
+void launchCommand(char **args) {
+   if (args[0] == NULL) {
+      printf("Programs are started with %s\n",
+	     launcher == LAUNCH_SPAWN ? "spawn" : "fork");
+   } else if (strcmp(args[0], "spawn") == 0) {
+      launcher = LAUNCH_SPAWN;
+   } else if (strcmp(args[0], "fork") == 0) {
+      launcher = LAUNCH_FORK;
+   } else {
+      printf("launch: expected spawn or fork\n");
+   }
+}
 
 /************************************
  * bool checkFilePath(string path)
@@ -593,57 +1498,189 @@ void execPath(string path, int p) {
  * the file 
  ***********************************/
 bool checkFilePath(string path) {
-   char **words = split_words(path.c_str());
-   int fileCheck = isFileExecutable(words[0]);
-   if (fileCheck == 0) {
+   return isFileExecutable(path.c_str()) != 0;
+}
+
+/************************************
+ * bool dirChanged(pathDir &d)
+ * pre: d is an entry of pathDirs
+ * post: returns true if the directory
+ * was modified (or removed) since
+ * its mtime was last recorded, and
+ * records the new mtime
+ ***********************************/
+bool dirChanged(pathDir &d) {
+   struct stat statinfo;
+   if (stat(d.name.c_str(), &statinfo) < 0) {
+      statinfo.st_mtim.tv_sec = statinfo.st_mtim.tv_nsec = -1;
+   }
+   bool changed = (statinfo.st_mtim.tv_sec != d.mtime.tv_sec ||
+		   statinfo.st_mtim.tv_nsec != d.mtime.tv_nsec);
+   d.mtime = statinfo.st_mtim;
+   return changed;
+}
+
+/************************************
+ * void loadPathDirs()
+ * pre: none
+ * post: pathDirs holds the directories
+ * of the current $PATH; if $PATH has
+ * changed the hash table is emptied
+ ***********************************/
+void loadPathDirs() {
+   const char *env = getVar("PATH");
+   string value = (env != NULL) ? env : DEFAULT_PATH;
+   if (value == pathValue && !pathDirs.empty()) {
+      return;
+   }
+   pathValue = value;
+   pathDirs.clear();
+   commandHash.clear();
+   size_t begin = 0;
+   while (true) {
+      size_t colon = value.find(':', begin);
+      string dir = value.substr(begin, colon == string::npos ? string::npos : colon - begin);
+      pathDir d;
+      d.name = (dir == "") ? "." : dir;
+      d.mtime.tv_sec = d.mtime.tv_nsec = -1;
+      pathDirs.push_back(d);
+      if (colon == string::npos) {
+	 break;
+      }
+      begin = colon + 1;
+   }
+}
+
+/************************************
+ * bool hashLookup(const string &, string &)
+ * pre: program is a bare command name
+ * post: returns true and sets path to
+ * the program's absolute location if it
+ * is found in $PATH; results are cached
+ * and reused until the directory they
+ * were found in changes
+ ***********************************/
+bool hashLookup(const string &program, string &path) {
+   if (program == "" || program.find('/') != string::npos) {
       return false;
-   } 
-   return true;
+   }
+   loadPathDirs();
+
+   unordered_map<string, hashEntry>::iterator it = commandHash.find(program);
+   if (it != commandHash.end()) {
+      if (!dirChanged(pathDirs[it->second.dir])) {
+	 it->second.hits++;
+	 path = it->second.path;
+	 return true;
+      }
+      //something moved, forget everything like "hash -r" would
+      commandHash.clear();
+   }
+
+   for (int i = 0; i < (int)pathDirs.size(); i++) {
+      string candidate = pathDirs[i].name + "/" + program;
+      if (checkFilePath(candidate)) {
+	 dirChanged(pathDirs[i]);
+	 hashEntry e;
+	 e.path = candidate;
+	 e.dir = i;
+	 e.hits = 1;
+	 commandHash[program] = e;
+	 path = candidate;
+	 return true;
+      }
+   }
+   return false;
+}
+
+/************************************
+ * void hashCommand(char **args)
+ * pre: args are the words after "hash"
+ * post: with no args the remembered
+ * command locations are printed, with
+ * -r they are forgotten, otherwise each
+ * named program is looked up and added
+ ***********************************/
+void hashCommand(char **args) {
+   if (args[0] == NULL) {
+      if (commandHash.empty()) {
+	 printf("hash: hash table empty\n");
+      } else {
+	 printf("hits\tcommand\n");
+	 for (unordered_map<string, hashEntry>::iterator it = commandHash.begin();
+	      it != commandHash.end(); it++) {
+	    printf("%4d\t%s\n", it->second.hits, it->second.path.c_str());
+	 }
+      }
+   } else if (strcmp(args[0], "-r") == 0) {
+      commandHash.clear();
+      pathDirs.clear();
+   } else {
+      for (int i = 0; args[i] != NULL; i++) {
+	 string path;
+	 if (!hashLookup(args[i], path)) {
+	    printf("hash: %s: not found\n", args[i]);
+	 } else {
+	    commandHash[args[i]].hits = 0;
+	 }
+      }
+   }
 }
 
 /************************************
- * bool tryToExec(string, string &)
- * pre: program and input are valid
+ * bool tryToExec(command *cmd)
+ * pre: cmd is a parsed command
  * post: a true/false will be returned
  * depending on if there is a path 
- * found for the program given
- * the full path will be passed in 
- * the reference parameter input
+ * found for the program given;
+ * argv[0] of cmd is replaced by the
+ * full path of the program
  ***********************************/
-bool tryToExec(string program, string &input) {
-
-   bool exists = false;
-   int i = 0;
-   string path = "";
-   while (!exists && i < 3) {
-      switch (i) {
-      case 0:
-	 path = "/usr/local/bin/"+program;
-	 exists = checkFilePath(path);
-	 break;
-      case 1:
-	 path = "/bin/"+program;
-	 exists = checkFilePath(path);
-	 break;
-      case 2:
-	 path = "/usr/bin/"+program;
-	 exists = checkFilePath(path);
-      }
-      i++;
-   }
-   if (exists) {
-      char **words = split_words(input.c_str()); 
-      char **newList = stringlist_empty();
-      stringlist_append(&newList, path.c_str());
-      
-      int x = 1;
-      while (words[x] != NULL) {
-	 stringlist_append(&newList, words[x]);
-	 x++;
-      }
-      string newExec = stringlist_join(newList, " ");
-      input = newExec;
+bool tryToExec(command *cmd) {
+
+   if (cmd->argv[0] == NULL) {
+      return false;
+   }
+   string program = cmd->argv[0];
+   if (program.find('/') != string::npos) {
+      return checkFilePath(program);
+   }
+   string path;
+   if (hashLookup(program, path)) {
+      cmd->argv[0] = arena_strdup(&cmdArena, path.c_str());
       return true;
    }
    return false;
 }
+
+/************************************
+ * const char *lookupVar(const char *name)
+ * post: the value of $name, where $?
+ * is the last status and $$ the pid
+ * of the shell (not of a subshell);
+ * NULL if it isn't set
+ ***********************************/
+const char *lookupVar(const char *name) {
+   static char number[16];
+   if (strcmp(name, "?") == 0) {
+      snprintf(number, sizeof(number), "%d", lastStatus);
+      return number;
+   } else if (strcmp(name, "$") == 0) {
+      snprintf(number, sizeof(number), "%d", (int)shellPid);
+      return number;
+   }
+   return getVar(name);
+}
+
+/************************************
+ * char **commandEnvironment(command *)
+ * post: the environment cmd runs with:
+ * the exported variables, plus any
+ * NAME=value words written before it
+ ***********************************/
+char **commandEnvironment(command *cmd) {
+   if (cmd->assigns[0] == NULL) {
+      return varEnvironment();
+   }
+   return varEnvironmentWith(cmd->assigns, &cmdArena);
+}
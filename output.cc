@@ -0,0 +1,34 @@
+/*************************************************************
+ * output.cc
+ * Purpose: how msh buffers what it prints, see output.h
+*************************************************************/
+
+#include <stdio.h>
+#include "output.h"
+
+#define OUTPUT_BUFSIZE 65536
+
+static char outputBuffer[OUTPUT_BUFSIZE];
+
+/************************************
+ * void initOutput()
+ * pre: called at startup, before
+ * anything is printed
+ * post: std out is fully buffered,
+ * even on a terminal
+ ***********************************/
+void initOutput() {
+   setvbuf(stdout, outputBuffer, _IOFBF, sizeof(outputBuffer));
+}
+
+/************************************
+ * void flushOutput()
+ * pre: the shell is about to block,
+ * start a program, or write to std
+ * out without going through stdio
+ * post: everything printed so far
+ * has been written out
+ ***********************************/
+void flushOutput() {
+   fflush(stdout);
+}
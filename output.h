@@ -0,0 +1,17 @@
+/*************************************************************
+ * output.h
+ * Purpose: how msh buffers what it prints - std out is fully
+ * buffered, and flushed only when the shell is about to
+ * block (at the prompt, waiting on a job or a timer, before
+ * a read) or to start a program, so a command's output
+ * costs a write per buffer instead of one per line while
+ * still coming out in order with that of its children
+*************************************************************/
+
+#ifndef OUTPUT_H
+#define OUTPUT_H
+
+void initOutput();
+void flushOutput();
+
+#endif // OUTPUT_H
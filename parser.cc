@@ -0,0 +1,688 @@
+// parser.cc - Command-line parser for msh, built on the lexer library.
+// See parser.h for documentation regarding the use of these functions.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "parser.h"
+#include "lexer.h"
+#include "stringlist.h"
+#include "arena.h"
+#include "wildcard.h"
+
+// Operators recognized by the parser. The lexer reports special[i] as
+// TokenType 2+i, and picks the longest one that matches (so "&&" is never
+// mistaken for two '&'s).
+static const char *parser_specials[] = {
+    "|", "&", ">>", ">", "<", ";", "&&", "||", "(", ")",
+    ">&", "<&", "&>", "&>>", "<<<", "<<", "<<-", NULL
+};
+
+// parser_specials compiled for the lexer, built on first use.
+static lexer_specials *parser_trie = NULL;
+
+enum {
+    T_PIPE = 2,
+    T_AMP,
+    T_APPEND,
+    T_OUT,
+    T_IN,
+    T_SEMI,
+    T_AND,
+    T_OR,
+    T_LPAREN,
+    T_RPAREN,
+    T_OUTDUP,
+    T_INDUP,
+    T_ALLOUT,
+    T_ALLAPPEND,
+    T_STRING,
+    T_HEREDOC,
+    T_HEREDOC_TABS,
+};
+
+// Marker bytes around a variable name left in a word for expand_command(),
+// one for references outside quotes and one for those inside "...".
+#define VAR_MARK '\001'
+#define VAR_MARK_QUOTED '\002'
+
+// Marker byte in front of an unquoted word with wildcards, left for
+// expand_command(). Such a word keeps its escapes ("\*") for the matcher.
+#define GLOB_MARK '\003'
+
+// What ends a list: the end of the line, a ')' or a '}'.
+enum {
+    END_LINE = 0,
+    END_PAREN,
+    END_BRACE,
+};
+
+// Parser state for one line.
+struct parser {
+    lexer x;
+    arena *a;
+    const char *line;    // the caller's copy of the line, never modified
+    const char *errmsg;  // first error found, or NULL
+    int tstart;          // offset in line where the current token starts
+    int tend;            // offset in line just past the current token
+    int prev_end;        // offset in line just past the previous token
+};
+
+static cmdlist *parse_list(parser *ps, int end);
+
+// Advance to the next token, keeping track of where it sits in the line so
+// that the source text of each pipeline can be recovered.
+static void parser_next(parser *ps)
+{
+    ps->prev_end = ps->tend;
+    int before = ps->x.pos;
+    lexer_next(&ps->x);
+    ps->tstart = before + strspn(ps->line + before, " \t\r\n");
+    ps->tend = ps->x.pos;
+}
+
+// Is the current token the unquoted word w?
+static bool parser_is_word(parser *ps, char c)
+{
+    return ps->x.ttype == WORD && ps->tend - ps->tstart == 1 && ps->line[ps->tstart] == c;
+}
+
+// Is the current token a redirection operator?
+static bool parser_is_redirect(parser *ps)
+{
+    int t = ps->x.ttype;
+    return t == T_IN || t == T_OUT || t == T_APPEND || t == T_OUTDUP || t == T_INDUP ||
+        t == T_ALLOUT || t == T_ALLAPPEND || t == T_STRING || t == T_HEREDOC ||
+        t == T_HEREDOC_TABS;
+}
+
+// Record an error, unless there already is one.
+static void parser_error(parser *ps, const char *msg)
+{
+    if (ps->errmsg == NULL)
+        ps->errmsg = msg;
+}
+
+// Copy line[start, end) into the arena, minus trailing blanks.
+static char *parser_text(parser *ps, int start, int end)
+{
+    while (end > start && strchr(" \t\r\n", ps->line[end-1]))
+        end--;
+    return arena_strndup(ps->a, ps->line + start, end - start);
+}
+
+// Is c a character that can start (first) or continue a variable name?
+static bool is_name_char(char c, bool first)
+{
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_' ||
+        (!first && c >= '0' && c <= '9');
+}
+
+// If raw[0, n) starts with NAME=, return the index of the '=', otherwise -1.
+static int assignment_equals(const char *raw, int n)
+{
+    if (n == 0 || !is_name_char(raw[0], true))
+        return -1;
+    int i = 1;
+    while (i < n && is_name_char(raw[i], false))
+        i++;
+    return (i < n && raw[i] == '=') ? i : -1;
+}
+
+// Return the current word token, unquoted and unescaped. If it refers to any
+// variables, or has wildcards outside quotes, they are marked for
+// expand_command() and cmd->expand is set. The quoted parts of a NAME=value
+// word (which the lexer leaves in it) are unquoted here too.
+static char *parser_word(parser *ps, command *cmd)
+{
+    const char *raw = ps->line + ps->tstart;
+    int n = ps->tend - ps->tstart;
+    bool quoted = (raw[0] == '\'' || raw[0] == '"');
+    int equals = quoted ? -1 : assignment_equals(raw, n);
+    bool value_quotes = (equals >= 0 && (memchr(raw, '\'', n) != NULL ||
+                memchr(raw, '"', n) != NULL));
+    bool glob = (!quoted && wildcard_has_magic(raw, n));
+    if (raw[0] == '\'' || (!glob && !value_quotes && memchr(raw, '$', n) == NULL))
+        return lexer_token(&ps->x);
+
+    // Unescape the word again from its source text, the way the lexer does,
+    // but watching for unescaped '$'s. quote is the quote the text at i is
+    // inside of, if any.
+    char quote = 0;
+    if (raw[0] == '"') {
+        quote = '"';
+        raw++;
+        n -= 2;
+    }
+    char *word = (char *)arena_alloc(ps->a, 2 * n + 2);
+    char *out = word;
+    if (glob) {
+        *out++ = GLOB_MARK;
+        cmd->expand = true;
+    }
+    for (int i = 0; i < n; i++) {
+        char c = raw[i];
+        if (c == VAR_MARK || c == VAR_MARK_QUOTED || c == GLOB_MARK) {
+            parser_error(ps, "Error parsing command: control character in word.");
+            return word;
+        } else if (value_quotes && i > equals && (c == '\'' || c == '"') &&
+                (quote == 0 || quote == c)) {
+            quote = (quote == 0) ? c : 0;
+            continue;
+        } else if (c == '\\' && i + 1 < n) {
+            c = raw[++i];
+            if (glob && strchr("*?[\\", c) != NULL)
+                *out++ = '\\';
+            *out++ = (c == 'n') ? '\n' : (c == 'r') ? '\r' : (c == 't') ? '\t' : c;
+            continue;
+        } else if (glob && quote != 0 && strchr("*?[", c) != NULL) {
+            // a quoted wildcard only matches itself
+            *out++ = '\\';
+            *out++ = c;
+            continue;
+        } else if (c != '$' || quote == '\'' || i + 1 >= n) {
+            *out++ = c;
+            continue;
+        }
+
+        // a '$', see if a name follows
+        const char *name = raw + i + 1;
+        int len = 0, skip;
+        if (name[0] == '{') {
+            name++;
+            const char *close = (const char *)memchr(name, '}', n - (i + 2));
+            len = (close != NULL) ? close - name : -1;
+            bool ok = (len == 1 && (name[0] == '?' || name[0] == '$'));
+            if (!ok && len > 0) {
+                ok = is_name_char(name[0], true);
+                for (int k = 1; k < len && ok; k++)
+                    ok = is_name_char(name[k], false);
+            }
+            if (len <= 0 || !ok) {
+                parser_error(ps, "Error parsing command: bad ${...} variable.");
+                return word;
+            }
+            skip = len + 2;
+        } else if (name[0] == '?' || name[0] == '$') {
+            len = 1;
+            skip = 1;
+        } else {
+            while (i + 1 + len < n && is_name_char(name[len], len == 0))
+                len++;
+            skip = len;
+        }
+        if (len == 0) {
+            *out++ = c;
+            continue;
+        }
+        char mark = (quote != 0) ? VAR_MARK_QUOTED : VAR_MARK;
+        *out++ = mark;
+        memcpy(out, name, len);
+        out += len;
+        *out++ = mark;
+        i += skip;
+        cmd->expand = true;
+    }
+    *out = '\0';
+    return word;
+}
+
+// Is the current word an assignment, NAME=value with NAME unquoted?
+static bool parser_is_assignment(parser *ps)
+{
+    return assignment_equals(ps->line + ps->tstart, ps->tend - ps->tstart) >= 0;
+}
+
+// Add a new, empty pipeline to the end of a list and return it.
+static pipeline *list_add(arena *a, cmdlist *l, ListOp op)
+{
+    l->pipes = (pipeline *)arena_grow(a, l->pipes, l->npipes * sizeof(pipeline),
+            (l->npipes + 1) * sizeof(pipeline));
+    pipeline *p = &l->pipes[l->npipes++];
+    p->cmds = NULL;
+    p->ncmds = 0;
+    p->background = false;
+    p->text = NULL;
+    p->op = op;
+    return p;
+}
+
+// Add a new, empty command to the end of a pipeline and return its index.
+static int pipeline_add(arena *a, pipeline *p)
+{
+    p->cmds = (command *)arena_grow(a, p->cmds, p->ncmds * sizeof(command),
+            (p->ncmds + 1) * sizeof(command));
+    command *cmd = &p->cmds[p->ncmds];
+    cmd->argv = stringlist_empty_arena(a);
+    cmd->assigns = stringlist_empty_arena(a);
+    cmd->redirs = NULL;
+    cmd->nredirs = 0;
+    cmd->group = NULL;
+    cmd->subshell = false;
+    cmd->expand = false;
+    return p->ncmds++;
+}
+
+// Add a redirection of descriptor fd to a command. The target must already be
+// in the arena (or be NULL, for REDIR_DUP and REDIR_CLOSE).
+static void command_add_redirect(arena *a, command *cmd, RedirType type, int fd,
+        char *target, int dupfd)
+{
+    cmd->redirs = (redirect *)arena_grow(a, cmd->redirs, cmd->nredirs * sizeof(redirect),
+            (cmd->nredirs + 1) * sizeof(redirect));
+    redirect *r = &cmd->redirs[cmd->nredirs++];
+    r->type = type;
+    r->fd = fd;
+    r->target = target;
+    r->dupfd = dupfd;
+    r->delim = NULL;
+    r->strip_tabs = false;
+}
+
+// Is s a non-empty string of at most four digits (a usable descriptor)?
+static bool is_fd_number(const char *s, int n)
+{
+    if (n < 1 || n > 4)
+        return false;
+    for (int i = 0; i < n; i++)
+        if (s[i] < '0' || s[i] > '9')
+            return false;
+    return true;
+}
+
+// Parse the redirection at the current token into cmd. word_start and
+// word_end locate the last word added to cmd (or are -1): if it is a number
+// written right against the operator, it names the descriptor instead of
+// being an argument.
+static void parse_redirect(parser *ps, command *cmd, int word_start, int word_end)
+{
+    int t = ps->x.ttype;
+    bool input = (t == T_IN || t == T_INDUP || t == T_STRING || t == T_HEREDOC ||
+            t == T_HEREDOC_TABS);
+    int fd = input ? 0 : 1;
+    if (t != T_ALLOUT && t != T_ALLAPPEND && word_end == ps->tstart &&
+            is_fd_number(ps->line + word_start, word_end - word_start)) {
+        fd = atoi(ps->line + word_start);
+        if (cmd->group == NULL)
+            stringlist_pop(&cmd->argv);
+    }
+
+    parser_next(ps);
+    if (ps->x.ttype != WORD) {
+        parser_error(ps, "Error parsing command: missing file name after redirection.");
+        return;
+    }
+    bool plain = (t == T_OUTDUP || t == T_INDUP || t == T_HEREDOC || t == T_HEREDOC_TABS);
+    char *target = plain ? lexer_token(&ps->x) : parser_word(ps, cmd);
+    if (t == T_OUTDUP || t == T_INDUP) {
+        if (strcmp(target, "-") == 0)
+            command_add_redirect(ps->a, cmd, REDIR_CLOSE, fd, NULL, -1);
+        else if (is_fd_number(target, strlen(target)))
+            command_add_redirect(ps->a, cmd, REDIR_DUP, fd, NULL, atoi(target));
+        else
+            parser_error(ps, "Error parsing command: descriptor number or '-' expected after '>&' or '<&'.");
+    } else if (t == T_HEREDOC || t == T_HEREDOC_TABS) {
+        command_add_redirect(ps->a, cmd, REDIR_HEREDOC, fd, NULL, -1);
+        cmd->redirs[cmd->nredirs - 1].delim = target;
+        cmd->redirs[cmd->nredirs - 1].strip_tabs = (t == T_HEREDOC_TABS);
+    } else if (t == T_ALLOUT || t == T_ALLAPPEND) {
+        command_add_redirect(ps->a, cmd, (t == T_ALLOUT) ? REDIR_OUT : REDIR_APPEND, 1, target, -1);
+        command_add_redirect(ps->a, cmd, REDIR_DUP, 2, NULL, 1);
+    } else {
+        RedirType type = (t == T_IN) ? REDIR_IN : (t == T_OUT) ? REDIR_OUT :
+            (t == T_APPEND) ? REDIR_APPEND : REDIR_STRING;
+        command_add_redirect(ps->a, cmd, type, fd, target, -1);
+    }
+}
+
+// Is cmd still missing its program (or group)?
+static bool command_empty(command *cmd)
+{
+    return cmd->argv[0] == NULL && cmd->group == NULL && cmd->assigns[0] == NULL;
+}
+
+// Parse the group starting at the current '(' or '{' into cmd.
+static void parse_group(parser *ps, command *cmd)
+{
+    cmd->subshell = ((int)ps->x.ttype == T_LPAREN);
+    parser_next(ps);
+    cmd->group = parse_list(ps, cmd->subshell ? END_PAREN : END_BRACE);
+    if (ps->errmsg)
+        return;
+    if (cmd->group->npipes == 0)
+        parser_error(ps, "Error parsing command: empty group.");
+    else if (cmd->subshell && (int)ps->x.ttype != T_RPAREN)
+        parser_error(ps, "Error parsing command: missing ')'.");
+    else if (!cmd->subshell && !parser_is_word(ps, '}'))
+        parser_error(ps, "Error parsing command: missing '}'.");
+}
+
+// Parse one pipeline into p, stopping at the first token that can't be part
+// of it (a list operator, a closing ')' or the end of the line).
+static void parse_pipeline(parser *ps, pipeline *p)
+{
+    int start = ps->tstart;
+
+    // Index of the command currently being built, or -1 if the next word
+    // starts a new one (at the beginning of the pipeline and after each '|').
+    int cur = -1;
+
+    // Where the word just before the current token sits in the line (or -1
+    // if that token wasn't a word), in case it turns out to be the descriptor
+    // number of a redirection.
+    int word_start = -1, word_end = -1;
+
+    while (ps->x.ttype != NONE && ps->errmsg == NULL) {
+        int last_start = word_start, last_end = word_end;
+        word_start = word_end = -1;
+        if (last_end >= 0 && p->cmds[cur].group && !(parser_is_redirect(ps) && last_end == ps->tstart)) {
+            parser_error(ps, "Error parsing command: unexpected word after group.");
+            break;
+        }
+        switch ((int)ps->x.ttype) {
+            case WORD:
+                if (cur < 0 && parser_is_word(ps, '{')) {
+                    cur = pipeline_add(ps->a, p);
+                    parse_group(ps, &p->cmds[cur]);
+                    break;
+                }
+                if (cur >= 0 && p->cmds[cur].group) {
+                    // only the descriptor number of a redirection, checked below
+                    if (!is_fd_number(ps->line + ps->tstart, ps->tend - ps->tstart))
+                        parser_error(ps, "Error parsing command: unexpected word after group.");
+                    word_start = ps->tstart;
+                    word_end = ps->tend;
+                    break;
+                }
+                if (cur < 0)
+                    cur = pipeline_add(ps->a, p);
+                if (p->cmds[cur].argv[0] == NULL && parser_is_assignment(ps))
+                    stringlist_append_arena(ps->a, &p->cmds[cur].assigns,
+                            parser_word(ps, &p->cmds[cur]));
+                else
+                    stringlist_append_arena(ps->a, &p->cmds[cur].argv,
+                            parser_word(ps, &p->cmds[cur]));
+                word_start = ps->tstart;
+                word_end = ps->tend;
+                break;
+            case T_LPAREN:
+                if (cur >= 0) {
+                    parser_error(ps, "Error parsing command: unexpected '('.");
+                    break;
+                }
+                cur = pipeline_add(ps->a, p);
+                parse_group(ps, &p->cmds[cur]);
+                break;
+            case T_PIPE:
+                if (cur < 0 || command_empty(&p->cmds[cur]))
+                    parser_error(ps, "Error parsing command: missing command before '|'.");
+                cur = -1;
+                break;
+            case T_IN:
+            case T_OUT:
+            case T_APPEND:
+            case T_OUTDUP:
+            case T_INDUP:
+            case T_ALLOUT:
+            case T_ALLAPPEND:
+            case T_STRING:
+            case T_HEREDOC:
+            case T_HEREDOC_TABS:
+                if (cur < 0)
+                    cur = pipeline_add(ps->a, p);
+                parse_redirect(ps, &p->cmds[cur], last_start, last_end);
+                break;
+            default:
+                // not ours, let the list deal with it
+                if (cur < 0 || command_empty(&p->cmds[cur]))
+                    parser_error(ps, "Error parsing command: missing command.");
+                p->text = parser_text(ps, start, ps->prev_end > start ? ps->prev_end : start);
+                return;
+        }
+        if (ps->errmsg == NULL)
+            parser_next(ps);
+    }
+
+    if (ps->errmsg == NULL && (cur < 0 || command_empty(&p->cmds[cur])))
+        parser_error(ps, "Error parsing command: missing command.");
+    else if (word_end >= 0 && p->cmds[cur].group)
+        parser_error(ps, "Error parsing command: unexpected word after group.");
+    p->text = parser_text(ps, start, ps->prev_end);
+}
+
+// Wrap l->pipes[first..] (an '&&'/'||' chain about to go to the background)
+// into a single pipeline running the chain in a child shell.
+static void list_wrap_chain(parser *ps, cmdlist *l, int first, int start)
+{
+    cmdlist *inner = (cmdlist *)arena_alloc(ps->a, sizeof(cmdlist));
+    inner->npipes = l->npipes - first;
+    inner->pipes = (pipeline *)arena_alloc(ps->a, inner->npipes * sizeof(pipeline));
+    memcpy(inner->pipes, l->pipes + first, inner->npipes * sizeof(pipeline));
+    inner->pipes[0].op = LIST_SEQ;
+
+    l->npipes = first;
+    pipeline *p = list_add(ps->a, l, l->pipes[first].op);
+    int cur = pipeline_add(ps->a, p);
+    p->cmds[cur].group = inner;
+    p->cmds[cur].subshell = true;
+    p->text = parser_text(ps, start, ps->prev_end);
+}
+
+// Parse pipelines joined by list operators until the given end is reached.
+// The token that ended the list (if any) is left as the current token.
+static cmdlist *parse_list(parser *ps, int end)
+{
+    cmdlist *l = (cmdlist *)arena_alloc(ps->a, sizeof(cmdlist));
+    l->pipes = NULL;
+    l->npipes = 0;
+
+    ListOp op = LIST_SEQ;
+    int chain = 0;                  // first pipeline of the current &&/|| chain
+    int chain_start = ps->tstart;   // and where its text starts
+    while (ps->errmsg == NULL) {
+        int t = ps->x.ttype;
+        if (t == NONE || (end == END_PAREN && t == T_RPAREN) ||
+                (end == END_BRACE && parser_is_word(ps, '}'))) {
+            if (op != LIST_SEQ)
+                parser_error(ps, "Error parsing command: missing command after '&&' or '||'.");
+            break;
+        }
+        if (t == T_SEMI || t == T_AMP || t == T_AND || t == T_OR || t == T_RPAREN) {
+            parser_error(ps, (t == T_RPAREN) ? "Error parsing command: unexpected ')'." :
+                    "Error parsing command: missing command before list operator.");
+            break;
+        }
+
+        pipeline *p = list_add(ps->a, l, op);
+        op = LIST_SEQ;
+        parse_pipeline(ps, p);
+        if (ps->errmsg)
+            break;
+
+        t = ps->x.ttype;
+        if (t == T_AND || t == T_OR) {
+            op = (t == T_AND) ? LIST_AND : LIST_OR;
+        } else if (t == T_SEMI || t == T_AMP) {
+            if (t == T_AMP) {
+                if (l->npipes - chain > 1)
+                    list_wrap_chain(ps, l, chain, chain_start);
+                l->pipes[l->npipes-1].background = true;
+            }
+            op = LIST_SEQ;
+            chain = l->npipes;
+        } else {
+            continue;   // end of the list, or an error found above
+        }
+        parser_next(ps);
+        if (op == LIST_SEQ)
+            chain_start = ps->tstart;
+    }
+    return l;
+}
+
+// Expand the variables marked in word, allocating the result from a. If the
+// word is nothing but unquoted variables and they are all empty, returns NULL.
+// With glob set, wildcards in the values are escaped so they match literally.
+static char *expand_word(const char *word, arena *a, var_lookup lookup, bool glob)
+{
+    if (strchr(word, VAR_MARK) == NULL && strchr(word, VAR_MARK_QUOTED) == NULL)
+        return (char *)word;
+    strbuf sb;
+    strbuf_init(&sb, 64);
+    bool only_vars = true;
+    char name[256];
+    for (const char *w = word; *w != '\0'; ) {
+        if (*w != VAR_MARK && *w != VAR_MARK_QUOTED) {
+            strbuf_appendc(&sb, *w++);
+            only_vars = false;
+            continue;
+        }
+        const char *end = strchr(w + 1, *w);
+        int len = end - (w + 1);
+        if (len >= (int)sizeof(name))
+            len = sizeof(name) - 1;
+        memcpy(name, w + 1, len);
+        name[len] = '\0';
+        if (*w == VAR_MARK_QUOTED)
+            only_vars = false;
+        const char *value = lookup(name);
+        for (; value != NULL && *value != '\0'; value++) {
+            if (glob && strchr("*?[\\", *value) != NULL)
+                strbuf_appendc(&sb, '\\');
+            strbuf_appendc(&sb, *value);
+        }
+        w = end + 1;
+    }
+    char *s = strbuf_finish(&sb);
+    char *result = (only_vars && s[0] == '\0') ? NULL : arena_strdup(a, s);
+    free(s);
+    return result;
+}
+
+// Expand the variables in word, and take off its GLOB_MARK and escapes if it
+// has them, without matching any files.
+static char *expand_literal(const char *word, arena *a, var_lookup lookup)
+{
+    if (word[0] != GLOB_MARK)
+        return expand_word(word, a, lookup, false);
+    char *w = expand_word(word + 1, a, lookup, true);
+    if (w == (word + 1))
+        w = arena_strdup(a, w);
+    char *out = w;
+    for (const char *s = w; *s != '\0'; s++) {
+        if (*s == '\\' && s[1] != '\0')
+            s++;
+        *out++ = *s;
+    }
+    *out = '\0';
+    return w;
+}
+
+void expand_command(command *cmd, arena *a, var_lookup lookup)
+{
+    if (!cmd->expand)
+        return;
+    cmd->expand = false;
+
+    // Words that match files may grow the list, so build a new one. Listings
+    // are shared by all the command's patterns, and only made if needed.
+    wildcard_dirs *dirs = NULL;
+    char **argv = stringlist_empty_arena(a);
+    for (int i = 0; cmd->argv[i] != NULL; i++) {
+        char *w = cmd->argv[i];
+        if (w[0] == GLOB_MARK) {
+            char *pattern = expand_word(w + 1, a, lookup, true);
+            if (dirs == NULL)
+                dirs = wildcard_dirs_new(a);
+            if (wildcard_expand(dirs, pattern, &argv) > 0)
+                continue;
+            // nothing matched, so the word is kept as written
+            w = expand_literal(w, a, lookup);
+        } else {
+            w = expand_word(w, a, lookup, false);
+        }
+        if (w != NULL)
+            stringlist_append_arena(a, &argv, w);
+    }
+    cmd->argv = argv;
+    for (int i = 0; cmd->assigns[i] != NULL; i++)
+        cmd->assigns[i] = expand_literal(cmd->assigns[i], a, lookup);
+    for (int i = 0; i < cmd->nredirs; i++) {
+        redirect *r = &cmd->redirs[i];
+        if (r->target != NULL && r->type != REDIR_HEREDOC) {
+            char *w = expand_literal(r->target, a, lookup);
+            r->target = (w != NULL) ? w : arena_strdup(a, "");
+        }
+    }
+}
+
+cmdlist *parse_line(const char *line, arena *a, const char **errmsg)
+{
+    // The lexer keeps its one copy of the line in the arena and hands back
+    // words unescaped in place inside it, so they can be linked into the tree
+    // without any further copying.
+    parser ps;
+    ps.a = a;
+    ps.line = line;
+    ps.errmsg = NULL;
+    ps.tstart = ps.tend = ps.prev_end = 0;
+    lexer_init_views(&ps.x, line, a);
+    ps.x.specials = (char **)parser_specials;
+    if (parser_trie == NULL)
+        parser_trie = lexer_compile_specials(ps.x.specials);
+    ps.x.compiled = parser_trie;
+
+    parser_next(&ps);
+    cmdlist *l = parse_list(&ps, END_LINE);
+    if (ps.errmsg == NULL && ps.x.errmsg)
+        ps.errmsg = ps.x.errmsg;
+    if (ps.errmsg == NULL && ps.x.ttype != NONE)
+        ps.errmsg = ((int)ps.x.ttype == T_RPAREN) ? "Error parsing command: unexpected ')'." :
+            "Error parsing command: unexpected token.";
+
+    lexer_destroy(&ps.x);
+
+    *errmsg = ps.errmsg;
+    if (ps.errmsg)
+        return NULL;
+    return l;
+}
+
+#ifdef UNITTEST
+
+// Variables for the tests: only Y is set.
+static const char *test_lookup(const char *name)
+{
+    return (strcmp(name, "Y") == 0) ? "v" : NULL;
+}
+
+// Parse line, expand its first command and print its assignments and words.
+static void test_line(const char *line)
+{
+    arena a;
+    arena_init(&a);
+    const char *errmsg;
+    cmdlist *l = parse_line(line, &a, &errmsg);
+    if (l == NULL) {
+        printf("%s\n", errmsg);
+    } else {
+        command *cmd = &l->pipes[0].cmds[0];
+        expand_command(cmd, &a, test_lookup);
+        stringlist_print(cmd->assigns);
+        stringlist_print(cmd->argv);
+    }
+    arena_destroy(&a);
+}
+
+int main(void) {
+    test_line("X=\"a b\"");            // { "X=a b" } { }
+    test_line("X=\"*.c\" Z='$Y'");     // { "X=*.c", "Z=$Y" } { }
+    test_line("W=\"$Y w\" U=$Y");      // { "W=v w", "U=v" } { }
+    test_line("export FOO=\"x y\"");   // { } { "export", "FOO=x y" }
+    test_line("FOO='v' prog \"$Y\"");  // { "FOO=v" } { "prog", "v" }
+    test_line("A=p\"q r\"s't' prog"); // { "A=pq rst" } { "prog" }
+    test_line("X=\"a b");              // Error parsing string: no matching quote.
+    return 0;
+}
+
+#endif // UNITTEST
@@ -0,0 +1,125 @@
+#ifndef PARSER_H
+#define PARSER_H
+
+// parser.h - Command-line parser for msh, built on the lexer library.
+//
+// The parser runs the lexer over an input line exactly once and builds a small
+// syntax tree describing what the line asks for. For example, the line
+//   sort < names.txt | uniq -c > counts.txt &
+// becomes a list holding one pipeline with two commands and the background
+// flag set:
+//   cmds[0]: argv = { "sort", NULL },       redirs = { 0 < "names.txt" }
+//   cmds[1]: argv = { "uniq", "-c", NULL }, redirs = { 1 > "counts.txt" }
+// A here-document's body is on the lines after the one being parsed, which
+// the parser never sees: it leaves target NULL, and the caller reads the
+// bodies (in the order the redirections appear in the line) and fills them in.
+// Redirections may appear anywhere among a command's words, and each command
+// of a pipeline has its own, applied in the order written (after the pipe, so
+// "a 2>&1 | b" sends a's errors down the pipe too).
+// Words are fully unquoted and unescaped by the lexer, so each argv is ready to
+// be handed to execv() without any further splitting.
+//
+// A line may hold several pipelines joined by ';', '&&' and '||', which all
+// have the same precedence and group left to right, as in sh:
+//   make && ./test || say failed; say done
+// becomes a list of four pipelines whose ops are SEQ, AND, OR, SEQ. A command
+// may also be a group, "( list )" to run the list in a child shell or
+// "{ list; }" to run it in the current one; like other shells, '{' and '}' are
+// only recognized as the first word of a command. A chain of '&&' and '||'
+// ending in '&' is run in the background as a whole, so the parser wraps it
+// in a "( ... )" group.
+//
+// Every part of the tree (nodes, argv arrays, words and file names) is
+// allocated from an arena supplied by the caller, so a parsed line is released
+// in one step with arena_reset() once the command has finished.
+
+struct arena;
+struct cmdlist;
+
+// Kinds of redirection. A number written right before the operator, with no
+// space between ("2>err.txt"), picks the descriptor instead of the default.
+// "&> file" and "&>> file" are shorthand for "> file 2>&1" and
+// ">> file 2>&1", and are stored that way, as two redirections.
+enum RedirType {
+    REDIR_IN = 0,      // n< file    (n defaults to 0)
+    REDIR_OUT = 1,     // n> file    (n defaults to 1)
+    REDIR_APPEND = 2,  // n>> file   (n defaults to 1)
+    REDIR_DUP = 3,     // n>&m, n<&m (n defaults to 1 and 0), n becomes a copy of m
+    REDIR_CLOSE = 4,   // n>&-, n<&- n is closed
+    REDIR_STRING = 5,  // n<<< word  (n defaults to 0) n reads the word and a newline
+    REDIR_HEREDOC = 6, // n<< word, n<<- word (n defaults to 0) n reads the body
+};
+
+// One redirection attached to a command.
+struct redirect {
+    RedirType type;
+    int fd;            // descriptor in the child that gets redirected
+    char *target;      // file name, the word of a here-string, or a here-document's body
+    int dupfd;         // REDIR_DUP only: the descriptor that is copied
+    char *delim;       // REDIR_HEREDOC only: the word that ends the body
+    bool strip_tabs;   // REDIR_HEREDOC only: written <<-, leading tabs are removed
+};
+
+// How a pipeline is joined to the one before it in a list.
+enum ListOp {
+    LIST_SEQ = 0,      // a ; b      (or a & b), b always runs
+    LIST_AND = 1,      // a && b     b runs if a succeeded
+    LIST_OR = 2,       // a || b     b runs if a failed
+};
+
+// One program invocation, or one group: its arguments and its redirections.
+struct command {
+    char **argv;       // stringlist of words, argv[0] is the program; empty for a group
+    char **assigns;    // stringlist of NAME=value words written before the program
+    redirect *redirs;  // array of nredirs redirections, in the order given
+    int nredirs;
+    cmdlist *group;    // the list inside ( ) or { }, or NULL for a program
+    bool subshell;     // group was written with ( ), so it runs in a child shell
+    bool expand;       // some word or file name still holds variables or wildcards, see expand_command()
+};
+
+// A sequence of commands connected by '|', optionally run in the background.
+struct pipeline {
+    command *cmds;     // array of ncmds commands, left to right
+    int ncmds;
+    bool background;   // pipeline ended with '&'
+    char *text;        // source text of the pipeline, for job listings
+    ListOp op;         // how it is joined to the previous pipeline of its list
+};
+
+// Pipelines joined by ';', '&', '&&' and '||'.
+struct cmdlist {
+    pipeline *pipes;   // array of npipes pipelines, left to right
+    int npipes;        // zero for a blank (or comment-only) line
+};
+
+// Variables ($NAME, ${NAME}, $? and $$, outside single quotes) are not looked
+// up by the parser, since an earlier command of the same line may still change
+// them. Each reference is left in its word between two marker bytes, and the
+// command's expand flag is set; expand_command() replaces them right before
+// the command runs. A word is never split, but an unquoted word made only of
+// variables that are all empty is dropped, as in sh.
+//
+// An unquoted word with wildcards ('*', '?', '[...]' or '**', see wildcard.h)
+// is marked the same way, and expand_command() replaces it with the paths it
+// matches, in sorted order; if there are none the word is kept as written.
+// Wildcards that come from a variable's value match only themselves, and file
+// names and assignments are never matched against files.
+//
+// Leading words of the form NAME=value go to the command's assigns instead of
+// its argv; a command may consist of nothing but those.
+
+// Look up a variable by name, returning NULL if it is not set.
+typedef const char *(*var_lookup)(const char *name);
+
+// Replace the variable references in cmd's words, assignments and file names,
+// and the words with wildcards by the paths they match, allocating the results
+// from arena a, and clear its expand flag.
+void expand_command(command *cmd, arena *a, var_lookup lookup);
+
+// Parse a line. On success, returns a new list allocated from arena a. On a
+// syntax error, returns NULL and sets *errmsg to a description of the problem.
+// Either way, anything the parser allocated is released with the arena.
+cmdlist *parse_line(const char *line, arena *a, const char **errmsg);
+
+#endif // PARSER_H
@@ -0,0 +1,338 @@
+/*************************************************************
+ * redirect.cc
+ * Purpose: descriptor plans for commands, see redirect.h
+ * note: the steps of a plan are the command's pipe ends
+ * followed by its redirections, in the order written, which
+ * is what gives "2>&1 >file" and ">file 2>&1" their
+ * different meanings. Before a plan is used, any dup2 or
+ * close whose descriptor is replaced by a later step
+ * without being copied first is dropped, so a stage of a
+ * pipeline whose output goes to a file never gets the pipe
+ * put on its std out at all
+*************************************************************/
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+#include "redirect.h"
+#include "parser.h"
+
+using namespace std;
+
+// Descriptors the shell makes for a plan are moved to this number or
+// above, out of the way of the ones people usually redirect.
+#define FIRST_TEMP_FD 10
+
+/************************************
+ * bool writeAll(int, const char *, size_t)
+ * post: all n bytes are written to
+ * fd, or false is returned
+ ***********************************/
+static bool writeAll(int fd, const char *s, size_t n) {
+   while (n > 0) {
+      ssize_t w = write(fd, s, n);
+      if (w < 0) {
+	 if (errno == EINTR) {
+	    continue;
+	 }
+	 return false;
+      }
+      s += w;
+      n -= w;
+   }
+   return true;
+}
+
+/************************************
+ * int textDescriptor(const char *, size_t)
+ * post: a close-on-exec descriptor
+ * that reads the text (and then EOF)
+ * is returned, or -1. Text that fits
+ * in a pipe without blocking goes in
+ * one; anything bigger goes in a
+ * memory file so nothing has to keep
+ * feeding a pipe while the child runs
+ ***********************************/
+static int textDescriptor(const char *text, size_t len) {
+   int fd;
+   if (len <= PIPE_BUF) {
+      int p[2];
+      if (pipe2(p, O_CLOEXEC) < 0) {
+	 return -1;
+      }
+      bool ok = writeAll(p[1], text, len);
+      close(p[1]);
+      if (!ok) {
+	 close(p[0]);
+	 return -1;
+      }
+      fd = p[0];
+   } else {
+      fd = memfd_create("msh-input", MFD_CLOEXEC);
+      if (fd < 0) {
+	 return -1;
+      }
+      if (!writeAll(fd, text, len) || lseek(fd, 0, SEEK_SET) < 0) {
+	 close(fd);
+	 return -1;
+      }
+   }
+   if (fd < FIRST_TEMP_FD) {
+      int moved = fcntl(fd, F_DUPFD_CLOEXEC, FIRST_TEMP_FD);
+      close(fd);
+      fd = moved;
+   }
+   return fd;
+}
+
+/************************************
+ * void addStep(redirPlan &, kind, fd, src, path, flags)
+ * post: the step is added to the plan
+ ***********************************/
+static void addStep(redirPlan &plan, fdKind kind, int fd, int src,
+		    const char *path, int flags) {
+   fdStep s;
+   s.kind = kind;
+   s.fd = fd;
+   s.src = src;
+   s.path = path;
+   s.flags = flags;
+   plan.steps.push_back(s);
+}
+
+/************************************
+ * void dropDeadSteps(redirPlan &)
+ * post: dup2s and closes that a later
+ * step undoes before anything reads
+ * them are gone. Opens stay, since
+ * creating or emptying the file is
+ * part of what they do
+ ***********************************/
+static void dropDeadSteps(redirPlan &plan) {
+   vector<fdStep> &steps = plan.steps;
+   vector<int> replaced; //descriptors a later step sets before any reads them
+   vector<bool> dead(steps.size(), false);
+   for (int i = steps.size() - 1; i >= 0; i--) {
+      fdStep &s = steps[i];
+      bool later = find(replaced.begin(), replaced.end(), s.fd) != replaced.end();
+      if (later && s.kind != FD_OPEN) {
+	 dead[i] = true;
+	 continue;
+      }
+      if (!later) {
+	 replaced.push_back(s.fd);
+      }
+      if (s.kind == FD_DUP) {
+	 replaced.erase(remove(replaced.begin(), replaced.end(), s.src), replaced.end());
+      }
+   }
+   size_t kept = 0;
+   for (size_t i = 0; i < steps.size(); i++) {
+      if (!dead[i]) {
+	 steps[kept++] = steps[i];
+      }
+   }
+   steps.resize(kept);
+}
+
+/************************************
+ * bool planRedirects(command *, int in, int out, redirPlan &)
+ * pre: in and out are the pipe ends
+ * the command gets as std in and std
+ * out, or -1 for none
+ * post: plan holds the steps that set
+ * up the command's descriptors; false
+ * is returned (after printing why) if
+ * a here-string couldn't be made
+ ***********************************/
+bool planRedirects(command *cmd, int in, int out, redirPlan &plan) {
+   plan.steps.clear();
+   plan.temps.clear();
+   if (in >= 0) {
+      addStep(plan, FD_DUP, 0, in, NULL, 0);
+   }
+   if (out >= 0) {
+      addStep(plan, FD_DUP, 1, out, NULL, 0);
+   }
+   for (int i = 0; i < cmd->nredirs; i++) {
+      redirect *r = &cmd->redirs[i];
+      switch (r->type) {
+      case REDIR_IN:
+	 addStep(plan, FD_OPEN, r->fd, -1, r->target, O_RDONLY);
+	 break;
+      case REDIR_OUT:
+	 addStep(plan, FD_OPEN, r->fd, -1, r->target, O_CREAT | O_WRONLY | O_TRUNC);
+	 break;
+      case REDIR_APPEND:
+	 addStep(plan, FD_OPEN, r->fd, -1, r->target, O_CREAT | O_WRONLY | O_APPEND);
+	 break;
+      case REDIR_DUP:
+	 if (r->dupfd != r->fd) {
+	    addStep(plan, FD_DUP, r->fd, r->dupfd, NULL, 0);
+	 }
+	 break;
+      case REDIR_CLOSE:
+	 addStep(plan, FD_CLOSE, r->fd, -1, NULL, 0);
+	 break;
+      case REDIR_STRING:
+      case REDIR_HEREDOC: {
+	 int fd;
+	 if (r->type == REDIR_STRING) {
+	    string text = string(r->target) + "\n";
+	    fd = textDescriptor(text.data(), text.size());
+	 } else {
+	    //a here-document's body already ends in a newline
+	    const char *body = (r->target != NULL) ? r->target : "";
+	    fd = textDescriptor(body, strlen(body));
+	 }
+	 if (fd < 0) {
+	    printf("error: can't make here-%s: %s\n",
+		   (r->type == REDIR_STRING) ? "string" : "document", strerror(errno));
+	    releaseRedirects(plan);
+	    return false;
+	 }
+	 plan.temps.push_back(fd);
+	 addStep(plan, FD_DUP, r->fd, fd, NULL, 0);
+	 break;
+      }
+      }
+   }
+   dropDeadSteps(plan);
+   return true;
+}
+
+/************************************
+ * bool applyRedirects(const redirPlan &)
+ * pre: called in the child
+ * post: the plan's steps are done and
+ * its temporary descriptors closed;
+ * false is returned (after printing
+ * why) if a step failed
+ ***********************************/
+bool applyRedirects(const redirPlan &plan) {
+   for (size_t i = 0; i < plan.steps.size(); i++) {
+      const fdStep &s = plan.steps[i];
+      if (s.kind == FD_DUP) {
+	 if (dup2(s.src, s.fd) < 0) {
+	    printf("error: bad file descriptor %d\n", s.src);
+	    return false;
+	 }
+      } else if (s.kind == FD_CLOSE) {
+	 close(s.fd);
+      } else {
+	 //open before touching s.fd, so a failure can still be
+	 //reported on it when it is stdout
+	 int desc = open(s.path, s.flags, 0660);
+	 if (desc < 0) {
+	    printf("error: can't open file %s\n", s.path);
+	    return false;
+	 }
+	 if (desc != s.fd) {
+	    dup2(desc, s.fd);
+	    close(desc);
+	 }
+      }
+   }
+   for (size_t i = 0; i < plan.temps.size(); i++) {
+      bool used = false;
+      for (size_t j = 0; j < plan.steps.size(); j++) {
+	 used = used || plan.steps[j].fd == plan.temps[i];
+      }
+      if (!used) {
+	 close(plan.temps[i]);
+      }
+   }
+   return true;
+}
+
+/************************************
+ * void spawnRedirects(const redirPlan &, actions)
+ * post: the plan's steps are added to
+ * the file actions of a posix_spawn
+ ***********************************/
+void spawnRedirects(const redirPlan &plan, posix_spawn_file_actions_t *actions) {
+   for (size_t i = 0; i < plan.steps.size(); i++) {
+      const fdStep &s = plan.steps[i];
+      if (s.kind == FD_DUP) {
+	 posix_spawn_file_actions_adddup2(actions, s.src, s.fd);
+      } else if (s.kind == FD_CLOSE) {
+	 posix_spawn_file_actions_addclose(actions, s.fd);
+      } else {
+	 posix_spawn_file_actions_addclose(actions, s.fd);
+	 posix_spawn_file_actions_addopen(actions, s.fd, s.path, s.flags, 0660);
+      }
+   }
+}
+
+/************************************
+ * bool shellRedirects(redirPlan &, std::vector<fdSave> &)
+ * pre: called in the shell, for a
+ * builtin; std out has been flushed
+ * post: each descriptor the plan
+ * changes is saved to saved (as a
+ * close-on-exec copy, or -1 if it
+ * wasn't open) and the plan's steps
+ * are done; false is returned if a
+ * step failed, and either way
+ * restoreDescriptors() puts them back
+ ***********************************/
+bool shellRedirects(redirPlan &plan, vector<fdSave> &saved) {
+   for (size_t i = 0; i < plan.steps.size(); i++) {
+      int fd = plan.steps[i].fd;
+      bool seen = false;
+      for (size_t j = 0; j < saved.size(); j++) {
+	 seen = seen || saved[j].fd == fd;
+      }
+      if (!seen) {
+	 fdSave save = { fd, fcntl(fd, F_DUPFD_CLOEXEC, FIRST_TEMP_FD), fcntl(fd, F_GETFD) };
+	 saved.push_back(save);
+      }
+   }
+   if (!applyRedirects(plan)) {
+      return false;
+   }
+   //applyRedirects closed the temporaries it didn't keep
+   plan.temps.clear();
+   return true;
+}
+
+/************************************
+ * void restoreDescriptors(std::vector<fdSave> &)
+ * post: the descriptors saved by
+ * shellRedirects() are as they were
+ ***********************************/
+void restoreDescriptors(vector<fdSave> &saved) {
+   for (size_t i = saved.size(); i-- > 0; ) {
+      if (saved[i].copy >= 0) {
+	 //dup2 would leave the shell's own descriptors
+	 //inheritable
+	 dup3(saved[i].copy, saved[i].fd, (saved[i].flags & FD_CLOEXEC) ? O_CLOEXEC : 0);
+	 close(saved[i].copy);
+      } else {
+	 close(saved[i].fd);
+      }
+   }
+   saved.clear();
+}
+
+/************************************
+ * void releaseRedirects(redirPlan &)
+ * pre: called in the shell once the
+ * child has started (or won't)
+ * post: the descriptors the shell
+ * made for the plan are closed
+ ***********************************/
+void releaseRedirects(redirPlan &plan) {
+   for (size_t i = 0; i < plan.temps.size(); i++) {
+      close(plan.temps[i]);
+   }
+   plan.temps.clear();
+}
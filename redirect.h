@@ -0,0 +1,56 @@
+/*************************************************************
+ * redirect.h
+ * Purpose: sets up the descriptors of one command - the
+ * pipe ends it is given and its own redirections - either
+ * in a forked child or as posix_spawn file actions
+ * note: a plan is made in the shell first, so anything that
+ * has to exist before the child starts (the pipe holding a
+ * here-string) is made there, and the child only does the
+ * dup2s, opens and closes the plan lists; a builtin has the
+ * plan done in the shell itself, around the call, with the
+ * descriptors it changes saved and put back afterwards
+*************************************************************/
+
+#ifndef REDIRECT_H
+#define REDIRECT_H
+
+#include <spawn.h>
+#include <vector>
+
+struct command;
+
+// What a step of a plan does to its descriptor.
+enum fdKind { FD_DUP, FD_OPEN, FD_CLOSE };
+
+// One step of a plan: make descriptor fd a copy of src, open path on
+// fd, or close fd.
+struct fdStep {
+   fdKind kind;
+   int fd;
+   int src;          //FD_DUP
+   const char *path; //FD_OPEN
+   int flags;        //FD_OPEN
+};
+
+// Everything needed to set up a command's descriptors.
+struct redirPlan {
+   std::vector<fdStep> steps; //in the order they are done
+   std::vector<int> temps;    //descriptors the shell made for the plan
+};
+
+// A descriptor changed for a builtin, and the copy it is restored
+// from (-1 if it was closed to begin with).
+struct fdSave {
+   int fd;
+   int copy;
+   int flags;  //its F_GETFD flags
+};
+
+bool planRedirects(command *, int, int, redirPlan &);
+bool applyRedirects(const redirPlan &);
+void spawnRedirects(const redirPlan &, posix_spawn_file_actions_t *);
+bool shellRedirects(redirPlan &, std::vector<fdSave> &);
+void restoreDescriptors(std::vector<fdSave> &);
+void releaseRedirects(redirPlan &);
+
+#endif // REDIRECT_H
@@ -7,17 +7,67 @@
 #include <string.h>
 #include "stringlist.h"
 #include "lexer.h"
+#include "arena.h"
 
 // Note: Unlike most C code, this code has a lot of verbose error checking to
 // help novice programers discover bugs in client code.
 
-char **stringlist_empty() {
-    // An empty list is an array containing one element, a NULL.
-    char **list = (char **)malloc(1 * sizeof(char *));
+// Every stringlist is preceded in memory by this header, so the char ** that
+// clients see points just past it. The underlying array has room for cap
+// strings plus the terminating NULL.
+struct stringlist_header {
+    int len;      // number of strings, not counting the NULL
+    int cap;      // number of strings that fit before the array must grow
+    arena *mem;   // arena holding the list, or NULL if it was malloc()ed
+};
+
+// Smallest capacity given to a list that has to grow.
+#define STRINGLIST_MINCAP 4
+
+static stringlist_header *stringlist_hdr(char **list) {
+    return ((stringlist_header *)list) - 1;
+}
+
+static size_t stringlist_bytes(int cap) {
+    return sizeof(stringlist_header) + (cap + 1) * sizeof(char *);
+}
+
+// Allocate an empty list with room for cap strings, from arena a if it isn't
+// NULL, otherwise with malloc().
+static char **stringlist_alloc(arena *a, int cap) {
+    stringlist_header *h;
+    if (a)
+        h = (stringlist_header *)arena_alloc(a, stringlist_bytes(cap));
+    else
+        h = (stringlist_header *)malloc(stringlist_bytes(cap));
+    h->len = 0;
+    h->cap = cap;
+    h->mem = a;
+    char **list = (char **)(h + 1);
     list[0] = NULL;
     return list;
 }
 
+// Make sure a list has room for at least one more string, growing it
+// geometrically so that a sequence of appends takes amortized O(1) each.
+static void stringlist_reserve(char ***list) {
+    stringlist_header *h = stringlist_hdr(*list);
+    if (h->len < h->cap)
+        return;
+    int cap = (h->cap < STRINGLIST_MINCAP) ? STRINGLIST_MINCAP : 2 * h->cap;
+    if (h->mem)
+        h = (stringlist_header *)arena_grow(h->mem, h, stringlist_bytes(h->cap), stringlist_bytes(cap));
+    else
+        h = (stringlist_header *)realloc(h, stringlist_bytes(cap));
+    h->cap = cap;
+    *list = (char **)(h + 1);
+}
+
+char **stringlist_empty() {
+    // An empty list is an array containing one element, a NULL.
+    return stringlist_alloc(NULL, 0);
+}
+
 void stringlist_print(char **list) {
     if (list == NULL) {
         printf("list is NULL\n");
@@ -41,11 +91,49 @@ char *stringlist_to_string(char **list) {
     return stringlist_join(list, "");
 }
 
-static void strjoin(char **s, const char *suffix) {
-    char *t = (char *)malloc(strlen(*s) + strlen(suffix) + 1);
-    strcpy(t, *s);
-    strcat(t, suffix);
-    *s = t;
+void strbuf_init(strbuf *sb, size_t hint) {
+    sb->cap = (hint > 0) ? hint : 16;
+    sb->buf = (char *)malloc(sb->cap + 1);
+    sb->buf[0] = '\0';
+    sb->len = 0;
+}
+
+void strbuf_appendn(strbuf *sb, const char *str, size_t n) {
+    if (sb->len + n > sb->cap) {
+        size_t cap = 2 * sb->cap;
+        if (cap < sb->len + n)
+            cap = sb->len + n;
+        sb->buf = (char *)realloc(sb->buf, cap + 1);
+        sb->cap = cap;
+    }
+    memcpy(sb->buf + sb->len, str, n);
+    sb->len += n;
+    sb->buf[sb->len] = '\0';
+}
+
+void strbuf_append(strbuf *sb, const char *str) {
+    if (str == NULL) {
+        fprintf(stderr, "Error in %s: str can't be NULL\n", __PRETTY_FUNCTION__);
+        return;
+    }
+    strbuf_appendn(sb, str, strlen(str));
+}
+
+void strbuf_appendc(strbuf *sb, char c) {
+    strbuf_appendn(sb, &c, 1);
+}
+
+char *strbuf_finish(strbuf *sb) {
+    char *s = sb->buf;
+    sb->buf = NULL;
+    sb->len = sb->cap = 0;
+    return s;
+}
+
+void strbuf_free(strbuf *sb) {
+    free(sb->buf);
+    sb->buf = NULL;
+    sb->len = sb->cap = 0;
 }
 
 char *stringlist_join(char **list, const char *sep) {
@@ -57,13 +145,23 @@ char *stringlist_join(char **list, const char *sep) {
         fprintf(stderr, "Error in %s: sep can't be NULL\n", __PRETTY_FUNCTION__);
         sep = "";
     }
-    char *s = strdup("");
-    for (int i = 0; list[i] != NULL; i++) {
+    // Measure everything first so the result is allocated exactly once, then
+    // copy each piece into place in a single pass.
+    size_t seplen = strlen(sep);
+    size_t total = 0;
+    int n = stringlist_len(list);
+    for (int i = 0; i < n; i++)
+        total += strlen(list[i]);
+    if (n > 1)
+        total += (n - 1) * seplen;
+    strbuf sb;
+    strbuf_init(&sb, total);
+    for (int i = 0; i < n; i++) {
         if (i != 0)
-            strjoin(&s, sep);
-        strjoin(&s, list[i]);
+            strbuf_appendn(&sb, sep, seplen);
+        strbuf_append(&sb, list[i]);
     }
-    return s;
+    return strbuf_finish(&sb);
 }
 
 void stringlist_append(char ***list, const char *str) {
@@ -79,8 +177,12 @@ void stringlist_append(char ***list, const char *str) {
         fprintf(stderr, "Error in %s: str can't be NULL\n", __PRETTY_FUNCTION__);
         return;
     }
-    int n = stringlist_len(*list);
-    *list = (char **)realloc(*list, (n + 2) * sizeof(char *));
+    if (stringlist_hdr(*list)->mem) {
+        fprintf(stderr, "Error in %s: stringlist is in an arena, use stringlist_append_arena()\n", __PRETTY_FUNCTION__);
+        return;
+    }
+    stringlist_reserve(list);
+    int n = stringlist_hdr(*list)->len++;
     (*list)[n] = strdup(str);
     (*list)[n+1] = NULL;
 }
@@ -90,10 +192,7 @@ int stringlist_len(char **list) {
         fprintf(stderr, "Error in %s: stringlist can't be NULL\n", __PRETTY_FUNCTION__);
         return 0;
     }
-    int n = 0;
-    while (list[n] != NULL)
-        n++;
-    return n;
+    return stringlist_hdr(list)->len;
 }
 
 int stringlist_find(char **list, const char *target) {
@@ -118,10 +217,12 @@ char **stringlist_dup(char **list) {
         fprintf(stderr, "Error in %s: stringlist can't be NULL\n", __PRETTY_FUNCTION__);
         return stringlist_empty();
     }
-    char **copy = stringlist_empty();
-    for (int i = 0; list[i] != NULL; i++) {
-        stringlist_append(&copy, list[i]);
-    }
+    int n = stringlist_len(list);
+    char **copy = stringlist_alloc(NULL, n);
+    for (int i = 0; i < n; i++)
+        copy[i] = strdup(list[i]);
+    copy[n] = NULL;
+    stringlist_hdr(copy)->len = n;
     return copy;
 }
 
@@ -142,10 +243,11 @@ char **stringlist_copy(char **list, int start, int end) {
         fprintf(stderr, "Error in %s: start positoin can't be after end position\n", __PRETTY_FUNCTION__);
         return stringlist_empty();
     }
-    char **list2 = stringlist_empty();
-    for (int i = start; i < end; i++) {
-        stringlist_append(&list2, list[i]);
-    }
+    char **list2 = stringlist_alloc(NULL, end - start);
+    for (int i = start; i < end; i++)
+        list2[i - start] = strdup(list[i]);
+    list2[end - start] = NULL;
+    stringlist_hdr(list2)->len = end - start;
     return list2;
 }
 
@@ -161,6 +263,7 @@ char *stringlist_pop(char ***list) {
     }
     char *removed = (*list)[n - 1];
     (*list)[n - 1] = NULL;
+    stringlist_hdr(*list)->len = n - 1;
     return removed;
 }
 
@@ -178,12 +281,14 @@ char **stringlist_popn(char ***list, int count) {
         fprintf(stderr, "Error in %s: count can't be larger than list length\n", __PRETTY_FUNCTION__);
         return stringlist_empty();
     }
-    char **list2 = (char **)malloc((count + 1) * sizeof(char *));
+    char **list2 = stringlist_alloc(NULL, count);
     for (int i = 0; i < count; i++) {
         list2[i] = (*list)[n - count + i];
         (*list)[n - count + i] = NULL;
     }
     list2[count] = NULL;
+    stringlist_hdr(list2)->len = count;
+    stringlist_hdr(*list)->len = n - count;
     return list2;
 }
 
@@ -206,12 +311,14 @@ char **stringlist_split(char ***list, int pos) {
         return stringlist_empty();
     }
     int count = n - pos;
-    char **list2 = (char **)malloc((count + 1) * sizeof(char *));
+    char **list2 = stringlist_alloc(NULL, count);
     for (int i = 0; i < count; i++) {
         list2[i] = (*list)[n - count + i];
         (*list)[n - count + i] = NULL;
     }
     list2[count] = NULL;
+    stringlist_hdr(list2)->len = count;
+    stringlist_hdr(*list)->len = n - count;
     return list2;
 }
 
@@ -222,13 +329,101 @@ void stringlist_free(char ***list) {
     }
     if (*list == NULL)
         return;
+    if (stringlist_hdr(*list)->mem) {
+        fprintf(stderr, "Error in %s: stringlist is in an arena, reset the arena instead\n", __PRETTY_FUNCTION__);
+        return;
+    }
     for (int i = 0; (*list)[i] != NULL; i++) {
         free((*list)[i]);
     }
-    free(*list);
+    free(stringlist_hdr(*list));
     *list = NULL;
 }
 
+char **stringlist_empty_arena(arena *a) {
+    return stringlist_alloc(a, 0);
+}
+
+void stringlist_append_arena(arena *a, char ***list, char *str) {
+    if (list == NULL) {
+        fprintf(stderr, "Error in %s: pointer to stringlist can't be NULL\n", __PRETTY_FUNCTION__);
+        return;
+    }
+    if (*list == NULL) {
+        fprintf(stderr, "Error in %s: stringlist can't be NULL\n", __PRETTY_FUNCTION__);
+        return;
+    }
+    if (str == NULL) {
+        fprintf(stderr, "Error in %s: str can't be NULL\n", __PRETTY_FUNCTION__);
+        return;
+    }
+    if (stringlist_hdr(*list)->mem != a) {
+        fprintf(stderr, "Error in %s: stringlist is not in this arena\n", __PRETTY_FUNCTION__);
+        return;
+    }
+    stringlist_reserve(list);
+    int n = stringlist_hdr(*list)->len++;
+    (*list)[n] = str;
+    (*list)[n+1] = NULL;
+}
+
+char **stringlist_copy_arena(arena *a, char **list, int start, int end) {
+    if (list == NULL) {
+        fprintf(stderr, "Error in %s: stringlist can't be NULL\n", __PRETTY_FUNCTION__);
+        return stringlist_empty_arena(a);
+    }
+    if (start < 0) {
+        fprintf(stderr, "Error in %s: start position can't be negative\n", __PRETTY_FUNCTION__);
+        return stringlist_empty_arena(a);
+    }
+    if (end > stringlist_len(list)) {
+        fprintf(stderr, "Error in %s: end position can't be past the end of the list\n", __PRETTY_FUNCTION__);
+        return stringlist_empty_arena(a);
+    }
+    if (start > end) {
+        fprintf(stderr, "Error in %s: start positoin can't be after end position\n", __PRETTY_FUNCTION__);
+        return stringlist_empty_arena(a);
+    }
+    char **list2 = stringlist_alloc(a, end - start);
+    for (int i = start; i < end; i++)
+        list2[i - start] = list[i];
+    list2[end - start] = NULL;
+    stringlist_hdr(list2)->len = end - start;
+    return list2;
+}
+
+char **split_words_arena(arena *a, const char *str) {
+    if (str == NULL) {
+        fprintf(stderr, "Error in %s: str can't be NULL\n", __PRETTY_FUNCTION__);
+        return stringlist_empty_arena(a);
+    }
+
+    char **list = stringlist_empty_arena(a);
+    if (str[0] == '\0')
+        return list;
+
+    // Words are unescaped in place inside the lexer's copy of the line, so the
+    // only allocations are that buffer and the list itself.
+    lexer x;
+    lexer_init_views(&x, str, a);
+
+    lexer_next(&x);
+    while (x.ttype == WORD) {
+        stringlist_append_arena(a, &list, lexer_token(&x));
+        lexer_next(&x);
+    }
+
+    if (x.errmsg) {
+        fprintf(stderr, "Error in %s: %s\n", __PRETTY_FUNCTION__, x.errmsg);
+        lexer_destroy(&x);
+        return stringlist_empty_arena(a);
+    }
+
+    lexer_destroy(&x);
+
+    return list;
+}
+
 char **split_words(const char *str) {
     if (str == NULL) {
         fprintf(stderr, "Error in %s: str can't be NULL\n", __PRETTY_FUNCTION__);
@@ -242,12 +437,13 @@ char **split_words(const char *str) {
         return list;
 
     lexer x;
-    lexer_init(&x, str);
+    lexer_init_views(&x, str, NULL);
 
-    // Expecting zero or more words.
+    // Expecting zero or more words. Each one is copied exactly once, into the
+    // list, since the caller frees them individually.
     lexer_next(&x);
     while (x.ttype == WORD) {
-        stringlist_append(&list, x.tstr);
+        stringlist_append(&list, lexer_token(&x));
         lexer_next(&x);
     }
 
@@ -276,6 +472,12 @@ int main(void) {
     stringlist_print(list); // { "Ada", "Bob", "Cal" }
 
 
+    char **big = stringlist_empty();
+    for (int i = 0; i < 100000; i++)
+        stringlist_append(&big, "x");
+    printf("%d\n", stringlist_len(big)); // 100000
+    stringlist_free(&big);
+
     char *name = stringlist_pop(&list);
     stringlist_print(list); // { "Ada", "Bob" }
     stringlist_append(&list, name);
@@ -379,6 +581,37 @@ int main(void) {
     s = stringlist_join(list, "--");
     printf("%s\n", s); // Ada--Bob--Cal
     free(s);
+    stringlist_free(&list);
+
+    strbuf sb;
+    strbuf_init(&sb, 0);
+    for (int i = 0; i < 3; i++) {
+        strbuf_append(&sb, "Ada");
+        strbuf_appendc(&sb, '-');
+    }
+    strbuf_appendn(&sb, "Bobby", 3);
+    s = strbuf_finish(&sb);
+    printf("%s\n", s); // Ada-Ada-Ada-Bob
+    free(s);
+
+    list = split_words("Ada Bob Cal");
+
+    // Arena-backed lists
+
+    arena a;
+    arena_init(&a);
+    char **alist = split_words_arena(&a, "Ada 'Bob Cal' Foo");
+    stringlist_print(alist); // { "Ada", "Bob Cal", "Foo" }
+    stringlist_append_arena(&a, &alist, arena_strdup(&a, "Bar"));
+    stringlist_print(alist); // { "Ada", "Bob Cal", "Foo", "Bar" }
+    char **alist2 = stringlist_copy_arena(&a, alist, 1, 3);
+    stringlist_print(alist2); // { "Bob Cal", "Foo" }
+    arena_reset(&a);
+    alist = stringlist_empty_arena(&a);
+    for (int i = 0; i < 1000; i++)
+        stringlist_append_arena(&a, &alist, (char *)"x");
+    printf("%d\n", stringlist_len(alist)); // 1000
+    arena_destroy(&a);
 
     // Error handling
 
@@ -20,6 +20,14 @@
 // the above example, the length would be 2, since again, the length doesn't
 // count the NULL at the end.
 //
+// Behind the scenes, each list also records its length and capacity in a small
+// hidden header stored just before element 0. That makes stringlist_len() take
+// constant time, and lets stringlist_append() grow the array geometrically
+// instead of one slot at a time. The catch is that only lists created by these
+// functions are stringlists: a NULL terminated array you build yourself (or
+// the argv passed to main, or list+1 for some list) can be iterated like one,
+// but must not be passed to functions in this file.
+//
 // You can iterate over the elements like this:
 //   for (int i = 0; list[i] != NULL; i++)
 //     printf("Element %d is %s\n", i, list[i]);
@@ -33,6 +41,15 @@
 //    if (list[0] == NULL) { printf("List is empty\n"); }
 // Or, you can check if the length is zero:
 //    if (stringlist_len(list) == 0) { printf("List is empty\n"); }
+//
+// Lists can also live in an arena (see arena.h), using the *_arena variants at
+// the end of this file. An arena-backed list, and every string in it, is
+// released all at once when the arena is reset, so such a list must never be
+// passed to stringlist_free() or to any function that grows the list with
+// realloc(), like stringlist_append(). All the read-only functions (len, find,
+// join, print, and so on) work on either kind of list.
+
+struct arena;
 
 
 // Create and return a new stringlist containing no strings.
@@ -85,11 +102,15 @@ char *stringlist_to_string(char **list);
 // Join the elements a stringlist together, separated by sep, and return the
 // resulting string. For example,
 //   stringlist_to_string({"A", "B", "C", NULL}, ", ") --> "A, B, C"
+// The total size is computed first, so the result is built in a single
+// allocation and a single pass over the list. Call free() when you are done
+// with the returned string.
 char *stringlist_join(char **list, const char *sep);
 
 // Add a new string str to the end of a stringlist. This new string will replace
 // the NULL that was previously at the end of the underlying array and put a new
-// NULL at the new end. A copy of str is made. A pointer to the stringlist is
+// NULL at the new end. A copy of str is made. The underlying array grows by
+// doubling, so building a list of n strings takes O(n) time overall. A pointer to the stringlist is
 // passed in, because this function modifies the list parameter. For example, to
 // make a stringlist containing three strings:
 //   char **list = stringlist_empty();
@@ -98,7 +119,7 @@ char *stringlist_join(char **list, const char *sep);
 //   stringlist_append(&list, "Claire");
 void stringlist_append(char ***list, const char *str);
 
-// Count the number of strings in a stringlist.
+// Count the number of strings in a stringlist. This takes constant time.
 int stringlist_len(char **list);
 
 // Search a stringlist for a target word and return the position of the word if
@@ -142,4 +163,54 @@ char **stringlist_popn(char ***list, int count);
 // is the length of the list.
 char **stringlist_split(char ***list, int pos);
 
+// Arena-backed variant of stringlist_empty(). The new list is allocated from a.
+char **stringlist_empty_arena(arena *a);
+
+// Arena-backed variant of stringlist_append(). The list is grown inside arena
+// a. Unlike stringlist_append(), str is NOT copied: the list just points at it,
+// so it must stay valid as long as the list does (usually because it was
+// itself allocated from the same arena).
+void stringlist_append_arena(arena *a, char ***list, char *str);
+
+// Arena-backed variant of stringlist_copy(). The new list is allocated from a
+// and shares its strings with the original list.
+char **stringlist_copy_arena(arena *a, char **list, int start, int end);
+
+// Arena-backed variant of split_words(). The list and all of its words are
+// allocated from a, so nothing needs to be freed afterwards.
+char **split_words_arena(arena *a, const char *str);
+
+// A string builder collects a string piece by piece. Its buffer grows by
+// doubling, so appending n characters in total takes O(n) time no matter how
+// many pieces there are. The contents are always null terminated. For example:
+//   strbuf sb;
+//   strbuf_init(&sb, 0);
+//   strbuf_append(&sb, "Ada");
+//   strbuf_appendc(&sb, ' ');
+//   strbuf_append(&sb, "Bob");
+//   char *s = strbuf_finish(&sb); // "Ada Bob"
+//   ...
+//   free(s);
+struct strbuf {
+    char *buf;    // the string so far
+    size_t len;   // its length, not including the null terminator
+    size_t cap;   // characters that fit before the buffer must grow
+};
+
+// Initialize an empty builder with room for hint characters (or a small
+// default if hint is zero).
+void strbuf_init(strbuf *sb, size_t hint);
+
+// Append a string, the first n characters of a string, or a single character.
+void strbuf_append(strbuf *sb, const char *str);
+void strbuf_appendn(strbuf *sb, const char *str, size_t n);
+void strbuf_appendc(strbuf *sb, char c);
+
+// Return the built string, which the caller must free(). The builder is left
+// empty and must be initialized again before reuse.
+char *strbuf_finish(strbuf *sb);
+
+// Discard the built string.
+void strbuf_free(strbuf *sb);
+
 #endif // STRINGLIST_H
@@ -0,0 +1,358 @@
+/*************************************************************
+ * vars.cc
+ * Purpose: shell variables for msh, see vars.h
+ * note: variables live in an open addressing hash table
+ * (linear probing, with tombstones left by unset). Each one
+ * is kept as a single "NAME=value" string, so the
+ * environment handed to programs is just an array of
+ * pointers to the exported ones. That array is only
+ * rebuilt after an exported variable changes; every other
+ * launch reuses it as is
+*************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <ctype.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+#include "vars.h"
+#include "arena.h"
+
+using namespace std;
+
+extern char **environ;
+
+#define MIN_SLOTS 64
+
+// One slot of the table. pair is NULL for a slot never used, or
+// DELETED for one whose variable was unset.
+struct varSlot {
+   char *pair;     //"NAME=value", malloc()ed
+   uint32_t hash;
+   int namelen;
+   bool exported;
+};
+
+static char deletedMark;
+#define DELETED (&deletedMark)
+
+static varSlot *slots = NULL;
+static size_t nslots = 0;
+static size_t used = 0;   //slots that aren't empty, tombstones included
+static char **envp = NULL;
+static size_t envCap = 0;
+static bool envStale = true;
+
+/************************************
+ * uint32_t nameHash(const char *, int)
+ * post: FNV-1a hash of the name
+ ***********************************/
+static uint32_t nameHash(const char *name, int len) {
+   uint32_t h = 2166136261u;
+   for (int i = 0; i < len; i++) {
+      h = (h ^ (unsigned char)name[i]) * 16777619u;
+   }
+   return h;
+}
+
+/************************************
+ * int nameLength(const char *)
+ * post: the length of the variable
+ * name s starts with, ending at '='
+ * or the end of s; 0 if s doesn't
+ * start with a valid name
+ ***********************************/
+static int nameLength(const char *s) {
+   int n = 0;
+   if (!(isalpha((unsigned char)s[0]) || s[0] == '_')) {
+      return 0;
+   }
+   while (isalnum((unsigned char)s[n]) || s[n] == '_') {
+      n++;
+   }
+   return (s[n] == '\0' || s[n] == '=') ? n : 0;
+}
+
+/************************************
+ * varSlot *findSlot(const char *, int, uint32_t, bool)
+ * post: the slot holding the name, or
+ * NULL; with forInsert, the slot to
+ * put it in if it isn't there
+ ***********************************/
+static varSlot *findSlot(const char *name, int len, uint32_t h, bool forInsert) {
+   if (nslots == 0) {
+      return NULL;
+   }
+   varSlot *reuse = NULL;
+   for (size_t i = h & (nslots - 1); ; i = (i + 1) & (nslots - 1)) {
+      varSlot *s = &slots[i];
+      if (s->pair == NULL) {
+	 return !forInsert ? NULL : (reuse != NULL) ? reuse : s;
+      }
+      if (s->pair == DELETED) {
+	 if (reuse == NULL) {
+	    reuse = s;
+	 }
+      } else if (s->hash == h && s->namelen == len && memcmp(s->pair, name, len) == 0) {
+	 return s;
+      }
+   }
+}
+
+/************************************
+ * void growTable()
+ * post: there is room for at least
+ * one more variable, and at least a
+ * quarter of the slots are empty
+ ***********************************/
+static void growTable() {
+   if ((used + 1) * 4 < nslots * 3) {
+      return;
+   }
+   size_t count = 0;
+   for (size_t i = 0; i < nslots; i++) {
+      if (slots[i].pair != NULL && slots[i].pair != DELETED) {
+	 count++;
+      }
+   }
+   size_t newSize = MIN_SLOTS;
+   while (newSize < (count + 1) * 2) {
+      newSize *= 2;
+   }
+   varSlot *old = slots;
+   size_t oldSize = nslots;
+   slots = (varSlot *)calloc(newSize, sizeof(varSlot));
+   nslots = newSize;
+   used = 0;
+   for (size_t i = 0; i < oldSize; i++) {
+      if (old[i].pair != NULL && old[i].pair != DELETED) {
+	 *findSlot(old[i].pair, old[i].namelen, old[i].hash, true) = old[i];
+	 used++;
+      }
+   }
+   free(old);
+}
+
+/************************************
+ * varSlot *storePair(const char *pair, int len)
+ * pre: pair is "NAME=value" and len is
+ * the length of NAME
+ * post: the variable holds the value,
+ * and its slot is returned
+ ***********************************/
+static varSlot *storePair(const char *pair, int len) {
+   uint32_t h = nameHash(pair, len);
+   varSlot *s = findSlot(pair, len, h, false);
+   if (s == NULL) {
+      growTable();
+      s = findSlot(pair, len, h, true);
+      if (s->pair == NULL) {
+	 used++;
+      }
+      s->hash = h;
+      s->namelen = len;
+      s->exported = false;
+   } else {
+      free(s->pair);
+   }
+   s->pair = strdup(pair);
+   if (s->exported) {
+      envStale = true;
+   }
+   return s;
+}
+
+/************************************
+ * void initVars()
+ * post: every variable of msh's own
+ * environment is set and exported
+ ***********************************/
+void initVars() {
+   for (char **e = environ; *e != NULL; e++) {
+      int len = nameLength(*e);
+      if (len > 0 && (*e)[len] == '=') {
+	 storePair(*e, len)->exported = true;
+      }
+   }
+   envStale = true;
+}
+
+/************************************
+ * const char *getVar(const char *name)
+ * post: the value of the variable, or
+ * NULL if it isn't set
+ ***********************************/
+const char *getVar(const char *name) {
+   int len = strlen(name);
+   varSlot *s = findSlot(name, len, nameHash(name, len), false);
+   return (s != NULL) ? s->pair + len + 1 : NULL;
+}
+
+/************************************
+ * bool setVar(const char *pair)
+ * pre: pair is "NAME=value"
+ * post: the variable is set (and stays
+ * exported if it was); false if NAME
+ * isn't a valid name
+ ***********************************/
+bool setVar(const char *pair) {
+   int len = nameLength(pair);
+   if (len == 0 || pair[len] != '=') {
+      return false;
+   }
+   storePair(pair, len);
+   return true;
+}
+
+/************************************
+ * void unsetVar(const char *name)
+ * post: the variable is gone
+ ***********************************/
+void unsetVar(const char *name) {
+   int len = strlen(name);
+   varSlot *s = findSlot(name, len, nameHash(name, len), false);
+   if (s == NULL) {
+      return;
+   }
+   if (s->exported) {
+      envStale = true;
+   }
+   free(s->pair);
+   s->pair = DELETED;
+}
+
+/************************************
+ * char **varEnvironment()
+ * post: a NULL terminated array of the
+ * exported variables, for execve();
+ * it stays valid until a variable
+ * changes
+ ***********************************/
+char **varEnvironment() {
+   if (!envStale) {
+      return envp;
+   }
+   size_t n = 0;
+   for (size_t i = 0; i < nslots; i++) {
+      if (slots[i].pair != NULL && slots[i].pair != DELETED && slots[i].exported) {
+	 n++;
+      }
+   }
+   if (n + 1 > envCap) {
+      envCap = (n + 1) * 2;
+      envp = (char **)realloc(envp, envCap * sizeof(char *));
+   }
+   n = 0;
+   for (size_t i = 0; i < nslots; i++) {
+      if (slots[i].pair != NULL && slots[i].pair != DELETED && slots[i].exported) {
+	 envp[n++] = slots[i].pair;
+      }
+   }
+   envp[n] = NULL;
+   envStale = false;
+   return envp;
+}
+
+/************************************
+ * char **varEnvironmentWith(char **pairs, arena *a)
+ * pre: pairs are "NAME=value" strings
+ * post: the environment with those
+ * added (or replacing variables of the
+ * same name), allocated from a; the
+ * cached environment isn't touched
+ ***********************************/
+char **varEnvironmentWith(char **pairs, arena *a) {
+   char **base = varEnvironment();
+   size_t n = 0, extra = 0;
+   while (base[n] != NULL) {
+      n++;
+   }
+   while (pairs[extra] != NULL) {
+      extra++;
+   }
+   char **env = (char **)arena_alloc(a, (n + extra + 1) * sizeof(char *));
+   memcpy(env, base, n * sizeof(char *));
+   for (size_t i = 0; i < extra; i++) {
+      int len = nameLength(pairs[i]);
+      size_t j = 0;
+      while (j < n && !(strncmp(env[j], pairs[i], len + 1) == 0)) {
+	 j++;
+      }
+      env[j] = pairs[i];
+      if (j == n) {
+	 n++;
+      }
+   }
+   env[n] = NULL;
+   return env;
+}
+
+/************************************
+ * bool pairBefore(const char *, const char *)
+ * post: true if a sorts before b
+ ***********************************/
+static bool pairBefore(const char *a, const char *b) {
+   return strcmp(a, b) < 0;
+}
+
+/************************************
+ * int exportCommand(char **args)
+ * pre: args are NAME or NAME=value
+ * post: each variable is set (if a
+ * value is given, or to an empty one
+ * if it wasn't set) and exported;
+ * with no args, the exported ones are
+ * listed
+ ***********************************/
+int exportCommand(char **args) {
+   if (args[0] == NULL) {
+      vector<const char *> list;
+      for (char **e = varEnvironment(); *e != NULL; e++) {
+	 list.push_back(*e);
+      }
+      sort(list.begin(), list.end(), pairBefore);
+      for (size_t i = 0; i < list.size(); i++) {
+	 printf("export %s\n", list[i]);
+      }
+      return 0;
+   }
+   int status = 0;
+   for (int i = 0; args[i] != NULL; i++) {
+      int len = nameLength(args[i]);
+      if (len == 0) {
+	 printf("export: %s is not a valid name\n", args[i]);
+	 status = 1;
+	 continue;
+      }
+      varSlot *s;
+      if (args[i][len] == '=') {
+	 s = storePair(args[i], len);
+      } else {
+	 s = findSlot(args[i], len, nameHash(args[i], len), false);
+	 if (s == NULL) {
+	    string empty = string(args[i]) + "=";
+	    s = storePair(empty.c_str(), len);
+	 }
+      }
+      if (!s->exported) {
+	 s->exported = true;
+	 envStale = true;
+      }
+   }
+   return status;
+}
+
+/************************************
+ * int unsetCommand(char **args)
+ * pre: args are variable names
+ * post: each variable is removed
+ ***********************************/
+int unsetCommand(char **args) {
+   for (int i = 0; args[i] != NULL; i++) {
+      unsetVar(args[i]);
+   }
+   return 0;
+}
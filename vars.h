@@ -0,0 +1,23 @@
+/*************************************************************
+ * vars.h
+ * Purpose: shell variables for msh - set with NAME=value,
+ * read with $NAME, and passed on to programs when exported
+ * (everything inherited from msh's own environment starts
+ * out exported)
+*************************************************************/
+
+#ifndef VARS_H
+#define VARS_H
+
+struct arena;
+
+void initVars();
+const char *getVar(const char *);
+bool setVar(const char *);
+void unsetVar(const char *);
+char **varEnvironment();
+char **varEnvironmentWith(char **, arena *);
+int exportCommand(char **);
+int unsetCommand(char **);
+
+#endif // VARS_H
@@ -0,0 +1,410 @@
+/*************************************************************
+ * walk.cc
+ * Purpose: the find builtin, see walk.h
+ * note: every thread has its own queue of directories still
+ * to be read. A thread works depth first off the back of
+ * its own queue and, when that runs dry, steals from the
+ * front of someone else's, where the biggest (least
+ * explored) subtrees are. pending counts directories that
+ * are queued or being read, so the walk is over when it
+ * drops to zero.
+*************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <fnmatch.h>
+#include <signal.h>
+#include <sched.h>
+#include <time.h>
+#include <sys/stat.h>
+#include <atomic>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "walk.h"
+#include "output.h"
+
+using namespace std;
+
+#define WALK_DIRENT_BUFSIZE (64 * 1024)
+#define WALK_OUT_BUFSIZE (64 * 1024)
+#define WALK_MAX_THREADS 64
+
+// One thread's queue of directories to read.
+struct walkQueue {
+   mutex lock;
+   deque<string> dirs;
+};
+
+// Shared state of one find command.
+struct walker {
+   int nthreads;
+   walkQueue *queues;
+   atomic<long> pending;  //directories queued or being read
+   atomic<long> found;    //paths that passed the filters
+   atomic<bool> stop;     //^C was pressed
+   atomic<bool> failed;   //some directory couldn't be read
+   const char *name;      //-name pattern, or NULL
+   char type;             //-type f, d or l, or 0 for any
+   bool count;            //-count: print only how many were found
+   mutex outLock;         //one thread writes to std out at a time
+};
+
+// What each thread prints, a buffer at a time. These go straight to
+// std out with write() rather than through stdio, whose one buffer
+// would have every thread taking its lock for every path; stdio is
+// flushed before they start, and again after anything is printf()ed
+// while they may be in use.
+struct walkOutput {
+   walker *w;
+   char buf[WALK_OUT_BUFSIZE];
+   size_t len;
+};
+
+/************************************
+ * void walkFlush(walkOutput &)
+ * post: the thread's buffered paths
+ * are written out in one piece
+ ***********************************/
+static void walkFlush(walkOutput &out) {
+   lock_guard<mutex> hold(out.w->outLock);
+   size_t done = 0;
+   while (done < out.len) {
+      ssize_t n = write(1, out.buf + done, out.len - done);
+      if (n < 0) {
+	 if (errno == EINTR) {
+	    continue;
+	 }
+	 break;
+      }
+      done += n;
+   }
+   out.len = 0;
+}
+
+/************************************
+ * void walkPut(walkOutput &, const char *, size_t, const char *, size_t)
+ * post: the path dir/name and a
+ * newline are buffered (dir alone
+ * when name is empty)
+ ***********************************/
+static void walkPut(walkOutput &out, const char *dir, size_t dlen,
+		    const char *name, size_t nlen) {
+   size_t need = dlen + 1 + nlen + 1;
+   if (out.len + need > sizeof(out.buf)) {
+      walkFlush(out);
+      if (need > sizeof(out.buf)) {
+	 return;
+      }
+   }
+   memcpy(out.buf + out.len, dir, dlen);
+   out.len += dlen;
+   if (nlen > 0) {
+      if (dlen > 0 && dir[dlen - 1] != '/') {
+	 out.buf[out.len++] = '/';
+      }
+      memcpy(out.buf + out.len, name, nlen);
+      out.len += nlen;
+   }
+   out.buf[out.len++] = '\n';
+}
+
+/************************************
+ * char typeLetter(unsigned char)
+ * post: the -type letter for a d_type
+ ***********************************/
+static char typeLetter(unsigned char dtype) {
+   switch (dtype) {
+   case DT_DIR: return 'd';
+   case DT_LNK: return 'l';
+   case DT_REG: return 'f';
+   case DT_FIFO: return 'p';
+   case DT_SOCK: return 's';
+   case DT_CHR: return 'c';
+   case DT_BLK: return 'b';
+   }
+   return '?';
+}
+
+/************************************
+ * unsigned char modeType(mode_t)
+ * post: the d_type for a st_mode
+ ***********************************/
+static unsigned char modeType(mode_t mode) {
+   return S_ISDIR(mode) ? DT_DIR : S_ISLNK(mode) ? DT_LNK : S_ISREG(mode) ? DT_REG :
+      S_ISFIFO(mode) ? DT_FIFO : S_ISSOCK(mode) ? DT_SOCK : S_ISCHR(mode) ? DT_CHR :
+      S_ISBLK(mode) ? DT_BLK : DT_UNKNOWN;
+}
+
+/************************************
+ * bool walkMatch(walker *, const char *, unsigned char)
+ * post: true if an entry with this
+ * name and d_type passes the filters
+ ***********************************/
+static bool walkMatch(walker *w, const char *name, unsigned char dtype) {
+   if (w->type != 0 && typeLetter(dtype) != w->type) {
+      return false;
+   }
+   if (w->name != NULL && fnmatch(w->name, name, 0) != 0) {
+      return false;
+   }
+   return true;
+}
+
+/************************************
+ * void walkDirectory(walker *, int, string &, char *, walkOutput &)
+ * pre: dir is a directory counted in
+ * pending
+ * post: its entries are filtered and
+ * printed, its subdirectories queued
+ * on thread me, and it is no longer
+ * pending
+ ***********************************/
+static void walkDirectory(walker *w, int me, const string &dir, char *dents,
+			  walkOutput &out) {
+   int fd = open(dir.c_str(), O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+   if (fd < 0) {
+      char err[128];
+      string msg = "find: " + dir + ": " + strerror_r(errno, err, sizeof(err));
+      walkPut(out, msg.c_str(), msg.size(), "", 0);
+      w->failed = true;
+      w->pending--;
+      return;
+   }
+
+   vector<string> subdirs;
+   ssize_t n;
+   while ((n = getdents64(fd, dents, WALK_DIRENT_BUFSIZE)) > 0) {
+      for (ssize_t pos = 0; pos < n; ) {
+	 struct dirent64 *d = (struct dirent64 *)(dents + pos);
+	 pos += d->d_reclen;
+	 const char *name = d->d_name;
+	 if (name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'))) {
+	    continue;
+	 }
+	 unsigned char dtype = d->d_type;
+	 if (dtype == DT_UNKNOWN) {
+	    //some filesystems don't fill in d_type
+	    struct stat st;
+	    if (fstatat(fd, name, &st, AT_SYMLINK_NOFOLLOW) == 0) {
+	       dtype = modeType(st.st_mode);
+	    }
+	 }
+	 if (walkMatch(w, name, dtype)) {
+	    w->found++;
+	    if (!w->count) {
+	       walkPut(out, dir.data(), dir.size(), name, strlen(name));
+	    }
+	 }
+	 if (dtype == DT_DIR) {
+	    string sub = dir;
+	    if (sub.empty() || sub[sub.size() - 1] != '/') {
+	       sub += '/';
+	    }
+	    sub += name;
+	    subdirs.push_back(sub);
+	 }
+      }
+   }
+   if (n < 0) {
+      w->failed = true;
+   }
+   close(fd);
+
+   if (!subdirs.empty()) {
+      //count them before this directory stops being pending, so
+      //pending can't touch zero while there is still work
+      w->pending += subdirs.size();
+      lock_guard<mutex> hold(w->queues[me].lock);
+      for (size_t i = 0; i < subdirs.size(); i++) {
+	 w->queues[me].dirs.push_back(subdirs[i]);
+      }
+   }
+   w->pending--;
+}
+
+/************************************
+ * bool takeWork(walker *, int, string &)
+ * post: a directory for thread me is
+ * stored in dir and true returned,
+ * from its own queue if possible and
+ * stolen from another thread if not
+ ***********************************/
+static bool takeWork(walker *w, int me, string &dir) {
+   {
+      lock_guard<mutex> hold(w->queues[me].lock);
+      deque<string> &q = w->queues[me].dirs;
+      if (!q.empty()) {
+	 dir.swap(q.back());
+	 q.pop_back();
+	 return true;
+      }
+   }
+   for (int k = 1; k < w->nthreads; k++) {
+      walkQueue &victim = w->queues[(me + k) % w->nthreads];
+      lock_guard<mutex> hold(victim.lock);
+      if (!victim.dirs.empty()) {
+	 dir.swap(victim.dirs.front());
+	 victim.dirs.pop_front();
+	 return true;
+      }
+   }
+   return false;
+}
+
+/************************************
+ * bool interruptPending()
+ * post: true if ^C has been pressed;
+ * the signal is left for the event
+ * loop to collect
+ ***********************************/
+static bool interruptPending() {
+   sigset_t set;
+   sigpending(&set);
+   return sigismember(&set, SIGINT);
+}
+
+/************************************
+ * void walkThread(walker *, int)
+ * post: thread me has worked until
+ * nothing is pending anywhere
+ ***********************************/
+static void walkThread(walker *w, int me) {
+   char *dents = (char *)malloc(WALK_DIRENT_BUFSIZE);
+   walkOutput *out = new walkOutput;
+   out->w = w;
+   out->len = 0;
+   string dir;
+   int idle = 0;
+   long done = 0;
+   while (w->pending > 0 && !w->stop) {
+      if (takeWork(w, me, dir)) {
+	 walkDirectory(w, me, dir, dents, *out);
+	 idle = 0;
+	 //only the shell's own thread looks for ^C
+	 if (me == 0 && ++done % 256 == 0 && interruptPending()) {
+	    w->stop = true;
+	 }
+      } else if (++idle < 64) {
+	 sched_yield();
+      } else {
+	 //everyone else is busy with a directory; back off a little
+	 struct timespec pause = { 0, 50000 };
+	 nanosleep(&pause, NULL);
+	 if (me == 0 && interruptPending()) {
+	    w->stop = true;
+	 }
+      }
+   }
+   walkFlush(*out);
+   delete out;
+   free(dents);
+}
+
+/************************************
+ * int findCommand(char **args)
+ * pre: args are directories followed
+ * by any of -name pattern, -type f|d|l,
+ * -threads n and -count
+ * post: every path below the given
+ * directories (. if none) that passes
+ * the filters is printed, in no
+ * particular order; 1 is returned if
+ * some directory couldn't be read, and
+ * -1 (before doing anything) if args
+ * need options only the real find has
+ ***********************************/
+int findCommand(char **args) {
+   walker w;
+   w.name = NULL;
+   w.type = 0;
+   w.count = false;
+   w.nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+   vector<string> roots;
+   for (int i = 0; args[i] != NULL; i++) {
+      if (strcmp(args[i], "-name") == 0 && args[i + 1] != NULL) {
+	 w.name = args[++i];
+      } else if (strcmp(args[i], "-type") == 0 && args[i + 1] != NULL &&
+		 strchr("fdlpscb", args[i + 1][0]) != NULL) {
+	 w.type = args[++i][0];
+      } else if (strcmp(args[i], "-threads") == 0 && args[i + 1] != NULL) {
+	 w.nthreads = atoi(args[++i]);
+      } else if (strcmp(args[i], "-count") == 0) {
+	 w.count = true;
+      } else if (args[i][0] == '-') {
+	 return -1;
+      } else {
+	 roots.push_back(args[i]);
+      }
+   }
+   if (roots.empty()) {
+      roots.push_back(".");
+   }
+   if (w.nthreads < 1) {
+      w.nthreads = 1;
+   } else if (w.nthreads > WALK_MAX_THREADS) {
+      w.nthreads = WALK_MAX_THREADS;
+   }
+
+   //anything already printed through stdio has to come out
+   //before the threads start writing around it
+   flushOutput();
+
+   w.queues = new walkQueue[w.nthreads];
+   w.pending = 0;
+   w.found = 0;
+   w.stop = false;
+   w.failed = false;
+
+   //the roots themselves are checked here, and each directory
+   //among them goes to a different thread to start with
+   walkOutput *out = new walkOutput;
+   out->w = &w;
+   out->len = 0;
+   for (size_t i = 0; i < roots.size(); i++) {
+      struct stat st;
+      if (lstat(roots[i].c_str(), &st) < 0) {
+	 walkFlush(*out);
+	 printf("find: %s: %s\n", roots[i].c_str(), strerror(errno));
+	 flushOutput();
+	 w.failed = true;
+	 continue;
+      }
+      const char *base = strrchr(roots[i].c_str(), '/');
+      base = (base != NULL && base[1] != '\0') ? base + 1 : roots[i].c_str();
+      if (walkMatch(&w, base, modeType(st.st_mode))) {
+	 w.found++;
+	 if (!w.count) {
+	    walkPut(*out, roots[i].data(), roots[i].size(), "", 0);
+	 }
+      }
+      if (S_ISDIR(st.st_mode)) {
+	 w.pending++;
+	 w.queues[i % w.nthreads].dirs.push_back(roots[i]);
+      }
+   }
+   walkFlush(*out);
+   delete out;
+
+   vector<thread> helpers;
+   for (int i = 1; i < w.nthreads; i++) {
+      helpers.push_back(thread(walkThread, &w, i));
+   }
+   walkThread(&w, 0);
+   for (size_t i = 0; i < helpers.size(); i++) {
+      helpers[i].join();
+   }
+   delete [] w.queues;
+
+   if (w.count) {
+      printf("%ld\n", (long)w.found);
+   }
+   return (w.failed || w.stop) ? 1 : 0;
+}
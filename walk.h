@@ -0,0 +1,13 @@
+/*************************************************************
+ * walk.h
+ * Purpose: the find builtin - walks whole directory trees
+ * with several threads at once, printing the paths that
+ * pass its filters as soon as they are found
+*************************************************************/
+
+#ifndef WALK_H
+#define WALK_H
+
+int findCommand(char **);
+
+#endif // WALK_H
@@ -0,0 +1,483 @@
+// wildcard.cc - Pathname expansion ("globbing") for msh.
+// See wildcard.h for documentation regarding the use of these functions.
+
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include "wildcard.h"
+#include "stringlist.h"
+#include "arena.h"
+
+// Bytes of directory entries fetched per getdents64() call.
+#define WC_DIRENT_BUFSIZE 65536
+
+// Kinds of matcher steps.
+enum {
+    WC_CHAR,    // one given character
+    WC_ANY,     // ?
+    WC_STAR,    // *
+    WC_CLASS,   // [...]
+};
+
+// One step of a compiled component.
+struct wc_op {
+    int type;
+    unsigned char c;      // WC_CHAR
+    unsigned char *set;   // WC_CLASS: 256-bit map of the characters matched
+};
+
+// One '/'-separated component of a pattern, compiled.
+struct wc_component {
+    char *text;           // the component itself, for one without wildcards
+    bool magic;           // it has wildcards, so names must be matched
+    bool globstar;        // it is exactly "**"
+    bool dot;             // it starts with '.', so may match hidden names
+    wc_op *ops;
+    int nops;
+    // When the component is prefix*suffix (one '*', no other wildcards) a
+    // name is matched by comparing its ends, without running the ops.
+    bool simple;
+    char *prefix;
+    int prefix_len;
+    char *suffix;
+    int suffix_len;
+};
+
+// One entry of a directory.
+struct wc_entry {
+    char *name;
+    unsigned char type;   // DT_* from getdents64, may be DT_UNKNOWN
+};
+
+// The entries of one directory, in the cache.
+struct wc_listing {
+    char *path;           // as given to wc_list(), "" for the current directory
+    wc_entry *entries;
+    int n;
+    wc_listing *next;     // next listing in the same bucket
+};
+
+struct wildcard_dirs {
+    arena *a;
+    wc_listing **buckets;
+    int nbuckets;         // a power of two
+    int count;
+    char *buf;            // getdents64() buffer, allocated on first use
+};
+
+// State of one wildcard_expand().
+struct wc_walk {
+    wildcard_dirs *dirs;
+    wc_component *comps;
+    int ncomps;
+    char path[PATH_MAX];  // the path being built, path[0, len) at each step
+    char **found;         // malloc()ed, grown by doubling
+    int nfound;
+    int cap;
+};
+
+wildcard_dirs *wildcard_dirs_new(arena *a)
+{
+    wildcard_dirs *dirs = (wildcard_dirs *)arena_alloc(a, sizeof(wildcard_dirs));
+    dirs->a = a;
+    dirs->nbuckets = 16;
+    dirs->count = 0;
+    dirs->buckets = (wc_listing **)arena_alloc(a, dirs->nbuckets * sizeof(wc_listing *));
+    memset(dirs->buckets, 0, dirs->nbuckets * sizeof(wc_listing *));
+    dirs->buf = NULL;
+    return dirs;
+}
+
+// Return the index of the ']' closing the set that starts with the '[' at
+// s[i], or -1 if it isn't closed.
+static int wc_set_end(const char *s, int n, int i)
+{
+    int j = i + 1;
+    if (j < n && (s[j] == '!' || s[j] == '^'))
+        j++;
+    if (j < n && s[j] == ']')
+        j++;
+    while (j < n && s[j] != ']')
+        j++;
+    return (j < n) ? j : -1;
+}
+
+bool wildcard_has_magic(const char *s, int n)
+{
+    for (int i = 0; i < n; i++) {
+        if (s[i] == '\\')
+            i++;
+        else if (s[i] == '*' || s[i] == '?' || (s[i] == '[' && wc_set_end(s, n, i) >= 0))
+            return true;
+    }
+    return false;
+}
+
+// Hash of a directory path, FNV-1a.
+static unsigned int wc_hash(const char *s, int n)
+{
+    unsigned int h = 2166136261u;
+    for (int i = 0; i < n; i++)
+        h = (h ^ (unsigned char)s[i]) * 16777619u;
+    return h;
+}
+
+// Double the number of buckets in the cache.
+static void wc_rehash(wildcard_dirs *dirs)
+{
+    int n = dirs->nbuckets * 2;
+    wc_listing **buckets = (wc_listing **)arena_alloc(dirs->a, n * sizeof(wc_listing *));
+    memset(buckets, 0, n * sizeof(wc_listing *));
+    for (int i = 0; i < dirs->nbuckets; i++) {
+        wc_listing *l = dirs->buckets[i];
+        while (l != NULL) {
+            wc_listing *next = l->next;
+            unsigned int h = wc_hash(l->path, strlen(l->path)) & (n - 1);
+            l->next = buckets[h];
+            buckets[h] = l;
+            l = next;
+        }
+    }
+    dirs->buckets = buckets;
+    dirs->nbuckets = n;
+}
+
+// Return the entries of directory path[0, len), reading it the first time it
+// is asked for. A directory that can't be read has no entries.
+static wc_listing *wc_list(wildcard_dirs *dirs, const char *path, int len)
+{
+    unsigned int h = wc_hash(path, len);
+    for (wc_listing *l = dirs->buckets[h & (dirs->nbuckets - 1)]; l != NULL; l = l->next)
+        if ((int)strlen(l->path) == len && memcmp(l->path, path, len) == 0)
+            return l;
+
+    wc_listing *l = (wc_listing *)arena_alloc(dirs->a, sizeof(wc_listing));
+    l->path = arena_strndup(dirs->a, path, len);
+    l->entries = NULL;
+    l->n = 0;
+    int fd = open(len > 0 ? l->path : ".", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd >= 0) {
+        if (dirs->buf == NULL)
+            dirs->buf = (char *)arena_alloc(dirs->a, WC_DIRENT_BUFSIZE);
+        int cap = 0;
+        long n;
+        while ((n = getdents64(fd, dirs->buf, WC_DIRENT_BUFSIZE)) > 0) {
+            for (long pos = 0; pos < n; ) {
+                struct dirent64 *d = (struct dirent64 *)(dirs->buf + pos);
+                pos += d->d_reclen;
+                if (strcmp(d->d_name, ".") == 0 || strcmp(d->d_name, "..") == 0)
+                    continue;
+                if (l->n == cap) {
+                    int more = (cap < 64) ? 64 : 2 * cap;
+                    l->entries = (wc_entry *)arena_grow(dirs->a, l->entries,
+                            cap * sizeof(wc_entry), more * sizeof(wc_entry));
+                    cap = more;
+                }
+                l->entries[l->n].name = arena_strdup(dirs->a, d->d_name);
+                l->entries[l->n].type = d->d_type;
+                l->n++;
+            }
+        }
+        close(fd);
+    }
+
+    if (dirs->count >= dirs->nbuckets)
+        wc_rehash(dirs);
+    h &= dirs->nbuckets - 1;
+    l->next = dirs->buckets[h];
+    dirs->buckets[h] = l;
+    dirs->count++;
+    return l;
+}
+
+// Compile pattern component text[0, n) into c.
+static void wc_compile(arena *a, const char *text, int n, wc_component *c)
+{
+    c->text = (char *)arena_alloc(a, n + 1);
+    int len = 0;
+    for (int i = 0; i < n; i++) {
+        if (text[i] == '\\' && i + 1 < n)
+            i++;
+        c->text[len++] = text[i];
+    }
+    c->text[len] = '\0';
+    c->magic = wildcard_has_magic(text, n);
+    c->globstar = (n == 2 && text[0] == '*' && text[1] == '*');
+    c->dot = (len > 0 && c->text[0] == '.');
+    c->ops = (wc_op *)arena_alloc(a, (n + 1) * sizeof(wc_op));
+    c->nops = 0;
+    c->simple = false;
+    if (!c->magic)
+        return;
+
+    int stars = 0, others = 0;
+    for (int i = 0; i < n; i++) {
+        wc_op *op = &c->ops[c->nops++];
+        op->c = text[i];
+        op->set = NULL;
+        if (text[i] == '\\' && i + 1 < n) {
+            op->type = WC_CHAR;
+            op->c = text[++i];
+        } else if (text[i] == '*') {
+            op->type = WC_STAR;
+            stars++;
+            while (i + 1 < n && text[i + 1] == '*')
+                i++;
+        } else if (text[i] == '?') {
+            op->type = WC_ANY;
+            others++;
+        } else if (text[i] == '[') {
+            // without a closing ']', '[' is just a character
+            int j = wc_set_end(text, n, i);
+            if (j < 0) {
+                op->type = WC_CHAR;
+                continue;
+            }
+            op->type = WC_CLASS;
+            op->set = (unsigned char *)arena_alloc(a, 32);
+            memset(op->set, 0, 32);
+            int k = i + 1;
+            bool negate = (text[k] == '!' || text[k] == '^');
+            if (negate)
+                k++;
+            for (bool first = true; k < j; k++, first = false) {
+                unsigned char lo = text[k], hi = lo;
+                if (k + 2 < j && text[k + 1] == '-' && !(first && lo == ']')) {
+                    hi = text[k + 2];
+                    k += 2;
+                }
+                for (int ch = lo; ch <= hi; ch++)
+                    op->set[ch >> 3] |= 1 << (ch & 7);
+            }
+            if (negate)
+                for (int b = 0; b < 32; b++)
+                    op->set[b] = ~op->set[b];
+            others++;
+            i = j;
+        } else {
+            op->type = WC_CHAR;
+        }
+    }
+
+    if (stars == 1 && others == 0) {
+        int star = 0;
+        while (c->ops[star].type != WC_STAR)
+            star++;
+        c->simple = true;
+        c->prefix_len = star;
+        c->suffix_len = c->nops - star - 1;
+        c->prefix = (char *)arena_alloc(a, c->prefix_len + c->suffix_len + 1);
+        c->suffix = c->prefix + c->prefix_len;
+        for (int i = 0; i < c->nops; i++)
+            if (i != star)
+                c->prefix[i < star ? i : i - 1] = c->ops[i].c;
+    }
+}
+
+// Does the single step op match character ch?
+static bool wc_step(const wc_op *op, unsigned char ch)
+{
+    switch (op->type) {
+        case WC_CHAR:
+            return op->c == ch;
+        case WC_ANY:
+            return true;
+        default:
+            return (op->set[ch >> 3] >> (ch & 7)) & 1;
+    }
+}
+
+// Does name match component c (which has wildcards)?
+static bool wc_match(const wc_component *c, const char *name)
+{
+    if (name[0] == '.' && !c->dot)
+        return false;
+    if (c->simple) {
+        int n = strlen(name);
+        return n >= c->prefix_len + c->suffix_len &&
+            memcmp(name, c->prefix, c->prefix_len) == 0 &&
+            memcmp(name + n - c->suffix_len, c->suffix, c->suffix_len) == 0;
+    }
+
+    // Match left to right, remembering the last '*' seen; when a step
+    // fails, let that '*' take one more character and try again from there.
+    const wc_op *ops = c->ops;
+    int p = 0, star = -1;
+    const char *s = name, *star_s = NULL;
+    while (*s != '\0') {
+        if (p < c->nops && ops[p].type == WC_STAR) {
+            star = ++p;
+            star_s = s;
+        } else if (p < c->nops && wc_step(&ops[p], *s)) {
+            p++;
+            s++;
+        } else if (star >= 0) {
+            p = star;
+            s = ++star_s;
+        } else {
+            return false;
+        }
+    }
+    while (p < c->nops && ops[p].type == WC_STAR)
+        p++;
+    return p == c->nops;
+}
+
+// Record w->path[0, len) as a match.
+static void wc_found(wc_walk *w, int len)
+{
+    if (len == 0)
+        return;
+    if (w->nfound == w->cap) {
+        w->cap = (w->cap == 0) ? 64 : 2 * w->cap;
+        w->found = (char **)realloc(w->found, w->cap * sizeof(char *));
+    }
+    w->found[w->nfound++] = arena_strndup(w->dirs->a, w->path, len);
+}
+
+// Add name to w->path[0, len), returning the new length, or -1 if the path
+// would be too long.
+static int wc_append(wc_walk *w, int len, const char *name, bool slash)
+{
+    int n = strlen(name);
+    if (len + n + 2 > PATH_MAX)
+        return -1;
+    memcpy(w->path + len, name, n);
+    len += n;
+    if (slash)
+        w->path[len++] = '/';
+    w->path[len] = '\0';
+    return len;
+}
+
+// Is entry e, found in directory w->path[0, len), a directory? Links to
+// directories count only if follow is set.
+static bool wc_is_dir(wc_walk *w, int len, wc_entry *e, bool follow)
+{
+    if (e->type == DT_DIR)
+        return true;
+    if (e->type != DT_UNKNOWN && !(follow && e->type == DT_LNK))
+        return false;
+    int end = wc_append(w, len, e->name, false);
+    struct stat st;
+    bool dir = end >= 0 && (follow ? stat(w->path, &st) : lstat(w->path, &st)) == 0 &&
+        S_ISDIR(st.st_mode);
+    w->path[len] = '\0';
+    return dir;
+}
+
+// Match components i and on below directory w->path[0, len) (which is empty
+// or ends in '/').
+static void wc_walk_from(wc_walk *w, int len, int i)
+{
+    if (i == w->ncomps) {
+        wc_found(w, len);
+        return;
+    }
+    wc_component *c = &w->comps[i];
+    bool last = (i == w->ncomps - 1);
+
+    if (!c->magic) {
+        int end = wc_append(w, len, c->text, !last);
+        struct stat st;
+        if (end < 0)
+            return;
+        if (!last)
+            wc_walk_from(w, end, i + 1);
+        else if (lstat(w->path, &st) == 0)
+            wc_found(w, end);
+        return;
+    }
+
+    wc_listing *l = wc_list(w->dirs, w->path, len);
+    if (c->globstar) {
+        // zero directories here, then each directory below in turn
+        if (!last)
+            wc_walk_from(w, len, i + 1);
+        for (int k = 0; k < l->n; k++) {
+            wc_entry *e = &l->entries[k];
+            if (e->name[0] == '.')
+                continue;
+            bool dir = wc_is_dir(w, len, e, false);
+            if (last) {
+                int end = wc_append(w, len, e->name, false);
+                if (end >= 0)
+                    wc_found(w, end);
+            }
+            if (dir) {
+                int end = wc_append(w, len, e->name, true);
+                if (end >= 0)
+                    wc_walk_from(w, end, i);
+            }
+        }
+        return;
+    }
+
+    for (int k = 0; k < l->n; k++) {
+        wc_entry *e = &l->entries[k];
+        if (!wc_match(c, e->name))
+            continue;
+        if (last) {
+            int end = wc_append(w, len, e->name, false);
+            if (end >= 0)
+                wc_found(w, end);
+        } else if (wc_is_dir(w, len, e, true)) {
+            int end = wc_append(w, len, e->name, true);
+            if (end >= 0)
+                wc_walk_from(w, end, i + 1);
+        }
+    }
+    // leave the path as this level found it
+    w->path[len] = '\0';
+}
+
+// Order paths for qsort().
+static int wc_compare(const void *a, const void *b)
+{
+    return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+int wildcard_expand(wildcard_dirs *dirs, const char *pattern, char ***list)
+{
+    // Absolute patterns start the walk at "/", which is never matched.
+    int start = 0;
+    while (pattern[start] == '/')
+        start++;
+    int n = 1;
+    for (const char *p = pattern + start; *p != '\0'; p++)
+        if (*p == '/')
+            n++;
+
+    wc_walk *w = (wc_walk *)malloc(sizeof(wc_walk));
+    w->dirs = dirs;
+    w->comps = (wc_component *)arena_alloc(dirs->a, n * sizeof(wc_component));
+    w->ncomps = 0;
+    const char *p = pattern + start;
+    while (true) {
+        const char *slash = strchr(p, '/');
+        int len = (slash != NULL) ? slash - p : (int)strlen(p);
+        wc_compile(dirs->a, p, len, &w->comps[w->ncomps++]);
+        if (slash == NULL)
+            break;
+        p = slash + 1;
+    }
+    memcpy(w->path, pattern, start);
+    w->path[start] = '\0';
+    w->found = NULL;
+    w->nfound = 0;
+    w->cap = 0;
+
+    wc_walk_from(w, start, 0);
+
+    qsort(w->found, w->nfound, sizeof(char *), wc_compare);
+    for (int i = 0; i < w->nfound; i++)
+        stringlist_append_arena(dirs->a, list, w->found[i]);
+    int found = w->nfound;
+    free(w->found);
+    free(w);
+    return found;
+}
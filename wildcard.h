@@ -0,0 +1,48 @@
+#ifndef WILDCARD_H
+#define WILDCARD_H
+
+// wildcard.h - Pathname expansion ("globbing") for msh.
+//
+// wildcard_expand() finds the paths that match a pattern such as "*.log",
+// "src/*/test_??.c" or "**/Makefile". In each '/'-separated component:
+//   *      matches any string
+//   ?      matches any one character
+//   [...]  matches one character of a set, like [abc], [a-z0-9] or [!.] (also
+//          [^.]); a ']' right after the '[' (or "[!") is part of the set
+//   **     on its own as a whole component, matches zero or more directories
+//          (symbolic links to directories are not followed)
+// A '\\' makes the character after it an ordinary one, and a '[' with no ']'
+// to close it is just a '['.
+// As in sh, a name starting with '.' is only matched by a component that
+// starts with '.', and "." and ".." are never matched. A pattern ending in '/'
+// only matches directories.
+//
+// Each component is compiled once into a small matcher before any directory
+// is read. A component without wildcards is not matched at all, just checked
+// for (or descended into). Directories are read with getdents64() and kept in
+// a wildcard_dirs cache, so several patterns that look in the same directory
+// (like "*.c *.h") read it only once. For example:
+//   wildcard_dirs *dirs = wildcard_dirs_new(&a);
+//   char **argv = stringlist_empty_arena(&a);
+//   if (wildcard_expand(dirs, "*.c", &argv) == 0)
+//       stringlist_append_arena(&a, &argv, (char *)"*.c"); // no match, keep it
+//   wildcard_expand(dirs, "*.h", &argv);                   // . is not read again
+// The cache, the compiled patterns and every path found are allocated from
+// the arena given to wildcard_dirs_new(), so they all go away with it.
+
+struct arena;
+struct wildcard_dirs;
+
+// Make an empty directory cache, allocated from arena a.
+wildcard_dirs *wildcard_dirs_new(arena *a);
+
+// Does s[0, n) contain any wildcards ('*', '?' or a closed '[...]') that
+// aren't escaped with '\\'?
+bool wildcard_has_magic(const char *s, int n);
+
+// Append every path matching pattern to *list (an arena stringlist in the same
+// arena as dirs) in sorted order, and return how many there were. Nothing is
+// appended if there are none.
+int wildcard_expand(wildcard_dirs *dirs, const char *pattern, char ***list);
+
+#endif // WILDCARD_H